@@ -5,7 +5,10 @@
 #ifndef __BVH_H__
 #define __BVH_H__
 
+#include <collider.h>
+#include <modeling.h>
 #include <surface.h>
+#include <vector>
 
 /**
  * @brief (Has Pointer)
@@ -18,30 +21,136 @@ public:
     Surface *surface = nullptr;
 };
 
+/**
+ * @brief (Has Pointer) 一个Model的faces的BVH. 所有节点和所有FaceSurface各自连续分配.
+ */
+class ModelBVH {
+public:
+    BVHTree *root = nullptr;         // nodes[0], 如果没有节点则为nullptr
+    BVHTree *nodes = nullptr;        // 所有节点
+    uint32_t num_nodes = 0;          // number of nodes
+    FaceSurface *surfaces = nullptr; // 每个face对应一个FaceSurface, 叶节点的surface指向这里
+    uint32_t num_surfaces = 0;       // number of surfaces
+};
+
+/**
+ * @brief (No Pointer) build_model_bvh_with_options的参数
+ */
+class BVHBuildOptions {
+public:
+    static const int MEDIAN_SPLIT = 0;  // 沿最长轴按AABB中心的中位数划分
+    static const int SAH_SPLIT = 1;     // binned SAH object split
+    static const int SPATIAL_SPLIT = 2; // SBVH: binned SAH object split和spatial split中代价较小者
+
+    int split_method = MEDIAN_SPLIT;
+    int num_bins = 16;                 // SAH每个轴的bin数量, 至少为2
+    float max_reference_growth = 0.3f; // spatial split最多增加max_reference_growth * num_faces个图元引用(内存增长预算)
+    float overlap_threshold = 1e-5f;   // object split两侧AABB重叠面积 / 根节点面积超过该值时才尝试spatial split
+    float traversal_cost = 1;          // SAH中遍历一个内部节点的代价
+    float intersection_cost = 1;       // SAH中与一个图元求交的代价
+};
+
 /**
  * @brief center.axis of "a" is less than center.axis of "b"
  * @details 如果a和b的中心在axis上的投影相同, 返回false. 如果在axis上a的中心坐标比b小, 返回true. 其它情况返回false.
  * @param axis x=0, y=1, z=2. If not one of {0, 1, 2}, return false.
  */
-bool aabb_a_lt_b_along_axis(const AABB &a, const AABB &b, int axis) {
-    if (axis < 0 || axis > 2)
-        return false;
-    return (a.p0[axis] + a.p1[axis]) < (b.p0[axis] + b.p1[axis]);
-}
+bool aabb_a_lt_b_along_axis(const AABB &a, const AABB &b, int axis);
 
 /**
  * @brief 等价于aabb_a_lt_b_along_axis(a, b, 0)
  */
-bool aabb_a_lt_b_along_x(const AABB &a, const AABB &b) { return aabb_a_lt_b_along_axis(a, b, 0); }
+bool aabb_a_lt_b_along_x(const AABB &a, const AABB &b);
 
 /**
  * @brief 等价于aabb_a_lt_b_along_axis(a, b, 1)
  */
-bool aabb_a_lt_b_along_y(const AABB &a, const AABB &b) { return aabb_a_lt_b_along_axis(a, b, 1); }
+bool aabb_a_lt_b_along_y(const AABB &a, const AABB &b);
 
 /**
  * @brief 等价于aabb_a_lt_b_along_axis(a, b, 2)
  */
-bool aabb_a_lt_b_along_z(const AABB &a, const AABB &b) { return aabb_a_lt_b_along_axis(a, b, 2); }
+bool aabb_a_lt_b_along_z(const AABB &a, const AABB &b);
+
+/**
+ * @brief 为model->faces构建BVH, 存入model->bvh. 如果model->bvh已存在, 先释放旧的BVH.
+ * @details 等价于使用默认BVHBuildOptions (MEDIAN_SPLIT) 的build_model_bvh_with_options.
+ *  每个节点沿其AABB最长的轴, 按surface AABB中心的中位数划分. 每个叶节点恰好包含一个FaceSurface.
+ *  model->num_faces == 0时, model->bvh->root == nullptr.
+ *
+ * @param model (Sub Free) 会释放旧的model->bvh
+ * @param recursive 是否递归处理model->submodels
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [100+i] 递归第i个(从0开始)子模型时出现错误
+ */
+int build_model_bvh(Model *model, bool recursive);
+
+/**
+ * @brief 按options为model->faces构建BVH, 存入model->bvh. 如果model->bvh已存在, 先释放旧的BVH.
+ * @details Specifications: \n
+ *  (1) 每个叶节点恰好包含一个图元引用. SAH_SPLIT和SPATIAL_SPLIT在节点深度达到31后改用MEDIAN_SPLIT, 保证树深度小于64 \n
+ *  (2) SPATIAL_SPLIT会把跨越划分平面的face裁剪成两个引用, 分别放入两侧子树, 所以多个叶节点可能指向同一个FaceSurface,
+ *      叶节点的AABB是裁剪后的AABB. 引用总数不超过num_faces * (1 + max_reference_growth) \n
+ *  (3) 对于多边形较大且倾斜的场景(例如建筑模型), SPATIAL_SPLIT能显著减少兄弟节点的重叠
+ *
+ * @param model (Sub Free) 会释放旧的model->bvh
+ * @param options (Not Free)
+ * @param recursive 是否递归处理model->submodels
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr或options == nullptr \n
+ *  [2] options不合法 \n
+ *  [100+i] 递归第i个(从0开始)子模型时出现错误
+ */
+int build_model_bvh_with_options(Model *model, const BVHBuildOptions *options, bool recursive);
+
+/**
+ * @brief BVH的SAH代价: 每个节点的表面积 / 根节点表面积, 乘以内部节点的traversal_cost或叶节点的intersection_cost, 再求和
+ * @details 代价越小, 随机射线的期望遍历开销越小. 用于比较不同构建方法的质量.
+ *
+ * @param tree (Not Free) 如果是nullptr或根节点表面积为0, 返回0
+ */
+float bvh_sah_cost(const BVHTree *tree, float traversal_cost, float intersection_cost);
+
+/**
+ * @brief 释放model->bvh并置为nullptr
+ *
+ * @param model (Sub Free)
+ * @param recursive 是否递归处理model->submodels
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr
+ */
+int free_model_bvh(Model *model, bool recursive);
+
+/**
+ * @brief Ray与BVH中所有surfaces求交, 返回[t0, t1]内最近的交点
+ *
+ * @param tree (Not Free) 如果是nullptr, 返回false
+ * @param hit_record (Not Free) 最近交点的数据 (如果为nullptr, 自动忽略)
+ * @return true 相交
+ * @return false 不相交
+ */
+bool bvh_ray_hit(const BVHTree *tree, const Ray &ray, float t0, float t1, HitRecord *hit_record);
+
+/**
+ * @brief 与bvh_ray_hit相同, 但使用预先计算的射线数据, 用于同一条射线与多个BVH求交
+ * @details 节点用aabb_ray_slab测试, 叶节点调用Surface::ray_hit_precomputed
+ */
+bool bvh_ray_hit(const BVHTree *tree, const PrecomputedRay &ray, float t0, float t1, HitRecord *hit_record);
+
+/**
+ * @brief 用frustum裁剪BVH, 把可能与frustum相交的子树依次追加到candidates
+ * @details 从根节点开始逐层展开与frustum相交的内部节点, 丢弃分离的子节点. 完全在frustum内的节点和叶节点不再展开.
+ *  如果展开一个节点会使候选子树超过max_candidates个, 则保留该节点本身, 所以每条射线最多遍历max_candidates个子树.
+ *  对于完全在frustum内的射线, 依次对candidates调用bvh_ray_hit与直接对tree调用bvh_ray_hit的结果相同.
+ *
+ * @param tree (Not Free) 如果是nullptr, 不追加任何节点
+ * @param max_candidates 本次最多追加的子树数量, 至少为1
+ * @param candidates (Not Free)
+ */
+void bvh_frustum_cull(const BVHTree *tree, const Frustum &frustum, uint32_t max_candidates, std::vector<const BVHTree *> *candidates);
 
-#endif // __BVH_H__
\ No newline at end of file
+#endif // __BVH_H__
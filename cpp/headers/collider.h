@@ -13,9 +13,32 @@
 AABB aabb_merge(const AABB &a, const AABB &b);
 
 /**
- * @brief 如果三条分别与x, y, z轴平行的线能够将a和b分开, 则返回false, 否则返回true.
+ * @brief 如果存在一个与x, y或z轴垂直的平面能够将a和b分开, 则返回false, 否则返回true. 只有表面接触也返回true.
  */
 bool aabb_collide(const AABB &a, const AABB &b);
 
+/**
+ * @brief (No Pointer) 由若干半空间相交得到的凸体, 例如相机的视锥体
+ * @details 第i个半空间是{p | normals[i].dot(p) + offsets[i] >= 0}, normals不需要归一化
+ */
+class Frustum {
+public:
+    static const int MAX_PLANES = 6;
+
+    Eigen::Vector3f normals[MAX_PLANES];
+    float offsets[MAX_PLANES] = {0, 0, 0, 0, 0, 0};
+    int num_planes = 0; // number of planes
+};
+
+/**
+ * @brief 判断AABB与frustum的位置关系 (保守判断)
+ * @details 只检查AABB是否完全在某一个平面外侧, 所以少数靠近frustum棱角的AABB会被误判为相交, 但不会把相交的误判为分离.
+ * @return 状态码: \n
+ *  [0] 分离 \n
+ *  [1] 相交 \n
+ *  [2] AABB完全在frustum内
+ */
+int frustum_aabb_test(const Frustum &frustum, const AABB &aabb);
+
 
 #endif // __COLLIDER_H__
\ No newline at end of file
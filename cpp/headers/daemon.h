@@ -0,0 +1,43 @@
+/**
+ * @file daemon.h
+ * @brief 实现常驻内存的渲染服务: 场景及其BVH加载后保留在内存中, 通过Unix domain socket接收渲染请求
+ */
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include <cstdint>
+
+/**
+ * @brief 在socket_path上监听渲染请求, 直到收到SHUTDOWN请求
+ * @details Specifications: \n
+ *  (1) 每个连接发送一行请求, 以'\n'结尾, 参数以空格分隔: \n
+ *      RENDER <obj路径> <width> <height> <spp> <eye.x> <eye.y> <eye.z> <target.x> <target.y> <target.z> <up.x> <up.y> <up.z> <fov> \n
+ *      SHUTDOWN \n
+ *  (2) RENDER成功时返回PPM(P6)图片的字节流, 失败时返回一行"ERR <code>", 然后关闭连接. code: \n
+ *      [1] 请求格式错误 \n
+ *      [2] width, height或spp无效 \n
+ *      [3] 无法加载场景 \n
+ *      [4] 渲染失败 \n
+ *      [5] 无权执行SHUTDOWN \n
+ *  (3) 场景以(obj路径, 文件修改时间)为键缓存. 文件被修改后, 下一次请求会重新加载, 旧场景在没有请求使用后释放.
+ *      每个场景的大小按model_footprint统计; 所有场景之和超过cache_budget时, 释放最久未使用且没有请求正在使用的场景,
+ *      所以正在使用的场景可能使总量暂时超出cache_budget \n
+ *  (4) 多个请求并发执行, num_threads个渲染线程轮流从每个未完成的请求中取一个tile渲染, 所以各请求平分渲染线程 \n
+ *  (5) SHUTDOWN会停止接受新连接, 等待已接受的请求完成, 释放所有缓存的场景后返回.
+ *      只接受与服务进程同一用户(或root)的SHUTDOWN, 对端用户由SO_PEERCRED (BSD/macOS上是getpeereid)获得 \n
+ *  (6) obj路径不能包含空格 \n
+ *  (7) 同时最多处理64个连接, 超出的连接在listen队列中等待. 连接后10秒内没有发送完整请求行的连接返回ERR 1并被关闭,
+ *      所以空闲连接不会一直占用名额
+ * @param socket_path (Not Free) Unix domain socket路径. 如果该路径是上次异常退出遗留的socket, 会先被删除; 其它已存在的文件不会被删除,
+ *  见listen_address
+ * @param num_threads 渲染线程数量. 小于1时使用std::thread::hardware_concurrency()
+ * @param cache_budget 缓存场景的内存上限(字节). 0表示不保留没有请求使用的场景
+ * @return 状态码: \n
+ *  [0] 收到SHUTDOWN后正常退出 \n
+ *  [1] socket_path是nullptr或过长 \n
+ *  [2] 创建, 绑定或监听socket失败, 或socket_path已存在且不是无人监听的socket \n
+ *  [3] 当前平台不支持Unix domain socket
+ */
+int run_render_daemon(const char *socket_path, int num_threads, uint64_t cache_budget);
+
+#endif // __DAEMON_H__
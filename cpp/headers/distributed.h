@@ -0,0 +1,56 @@
+/**
+ * @file distributed.h
+ * @brief 实现多进程分布式渲染: coordinator把画面切分为tiles, 由worker进程动态领取渲染
+ */
+#ifndef __DISTRIBUTED_H__
+#define __DISTRIBUTED_H__
+
+#include <render.h>
+
+/**
+ * @brief 作为coordinator在address上监听workers, 渲染完整画面并写入ppm_path
+ * @details Specifications: \n
+ *  (1) address格式见listen_address, 例如"unix:/tmp/rt.sock"或"tcp:0.0.0.0:7000" \n
+ *  (2) 画面被切分为tile_size x tile_size的tiles. worker每完成一个tile就领取下一个, 快的worker自然领取更多tiles \n
+ *  (3) worker连接断开(进程退出, 崩溃, 网络错误)时, 它正在渲染的tile会重新分配给其它worker \n
+ *  (4) num_local_workers > 0时, coordinator会fork出num_local_workers个运行run_worker的本地进程. 如果所有本地worker都退出,
+ *      且没有其它worker连接, 而画面仍未完成, 则返回失败. num_local_workers == 0时一直等待远程worker \n
+ *  (5) 所有workers各自从obj_path加载场景, 所以obj_path必须在每个worker上都可访问且不能包含空格 \n
+ *  (6) render_tile的结果只由像素坐标决定, 所以输出与单进程渲染完全相同 \n
+ *  (7) tile_timeout > 0时, worker领取tile后tile_timeout秒内没有发回完整的结果, 就被视为卡死: 连接被关闭, tile重新分配.
+ *      所以tile_timeout应大于最慢的tile的渲染时间. 所有worker连接都开启keepalive, 掉线的远程主机也会被发现.
+ *      画面完成后, 本地worker在tile_timeout秒内仍未退出时会被SIGKILL终止 \n
+ *  (8) worker报告"FAIL <code>"时连接被关闭, tile重新分配. 同一个tile累计失败3次时放弃渲染, 返回100 + code
+ * @param address (Not Free)
+ * @param obj_path (Not Free)
+ * @param camera (Not Free)
+ * @param tile_timeout 每个tile的超时(秒), 0表示不超时
+ * @param ppm_path (Not Free) 输出图片路径
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] 参数是nullptr, 或width, height, spp, tile_size不是正数 \n
+ *  [2] 监听address失败 \n
+ *  [3] 所有本地worker都已退出, 画面未完成 \n
+ *  [4] 无法写入ppm_path \n
+ *  [5] 当前平台不支持 \n
+ *  [100 + i] 同一个tile被workers报告失败3次, i是最后一次报告的状态码(见render_tile)
+ */
+int run_coordinator(const char *address, const char *obj_path, const Camera *camera, int width, int height, int spp, int tile_size,
+                    int num_local_workers, int tile_timeout, const char *ppm_path);
+
+/**
+ * @brief 作为worker连接到coordinator, 加载一次场景后反复领取并渲染tiles, 直到coordinator通知完成
+ * @details coordinator尚未开始监听时, 会在10秒内重试连接
+ * @param address (Not Free) 格式见connect_address
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] address是nullptr \n
+ *  [2] 无法连接coordinator \n
+ *  [3] 收到无法识别的消息 \n
+ *  [4] 无法加载场景 \n
+ *  [5] 连接意外断开 \n
+ *  [6] 当前平台不支持
+ */
+int run_worker(const char *address);
+
+#endif // __DISTRIBUTED_H__
@@ -0,0 +1,106 @@
+/**
+ * @file footprint.h
+ * @brief 统计Model树及其BVH占用的内存, 以及在加载前根据obj文件估计内存
+ * @details 各类别统计的是new请求的字节数; 分配器为每次new额外占用的内存(chunk头和对齐)单独计入MemoryFootprint::allocator.
+ *  HEdge和pairs数组都是逐个分配的小对象, 所以这部分开销不可忽略.
+ */
+#ifndef __FOOTPRINT_H__
+#define __FOOTPRINT_H__
+
+#include <bvh.h>
+#include <cstdint>
+#include <modeling.h>
+#include <vector>
+
+/**
+ * @brief (No Pointer) 按类别统计的内存(字节)
+ */
+class MemoryFootprint {
+public:
+    uint64_t vertices = 0;    // Model::verts
+    uint64_t faces = 0;       // Model::faces
+    uint64_t hedges = 0;      // 所有HEdge
+    uint64_t pairs = 0;       // 所有HEdge::pairs数组
+    uint64_t model_lists = 0; // ModelList节点和子模型的Model对象 (不包括根节点的Model对象)
+    uint64_t names = 0;       // Model::name
+    uint64_t bvh = 0;         // ModelBVH, BVHTree节点和FaceSurface
+    uint64_t allocator = 0;   // 以上每次new的分配器开销之和, 见allocation_overhead
+
+    uint64_t total() const { return vertices + faces + hedges + pairs + model_lists + names + bvh + allocator; }
+
+    MemoryFootprint &operator+=(const MemoryFootprint &other) {
+        vertices += other.vertices;
+        faces += other.faces;
+        hedges += other.hedges;
+        pairs += other.pairs;
+        model_lists += other.model_lists;
+        names += other.names;
+        bvh += other.bvh;
+        allocator += other.allocator;
+        return *this;
+    }
+};
+
+/**
+ * @brief 估计一次new size字节时分配器额外占用的字节数
+ * @details 按64位glibc malloc的规则: chunk大小为max(32, size + 8向上对齐到16). 其它分配器的规则不同, 结果只是近似值.
+ *  超过mmap阈值的大块内存实际按页对齐, 但相对其大小可以忽略
+ */
+uint64_t allocation_overhead(uint64_t size);
+
+/**
+ * @brief (Has Pointer) 一个Model自身占用的内存, 不包括它的submodels
+ */
+class SubmodelFootprint {
+public:
+    const Model *model = nullptr;
+    int depth = 0; // 根节点为0
+    MemoryFootprint bytes;
+};
+
+/**
+ * @brief 统计model树占用的内存
+ * @details 子模型的ModelList节点和Model对象计入该子模型. 线程安全, 但统计期间model树不能被修改.
+ *
+ * @param model (Not Free)
+ * @param recursive 是否统计model->submodels
+ * @param total (Not Free) 输出, 所有统计到的Model之和
+ * @param submodels (Not Free) 输出, 按先序遍历顺序追加每个Model自身的统计 (如果为nullptr, 自动忽略)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] total == nullptr
+ */
+int model_footprint(const Model *model, bool recursive, MemoryFootprint *total, std::vector<SubmodelFootprint> *submodels);
+
+/**
+ * @brief 只扫描一遍obj文件的行首和f行的顶点数量(不解析数字), 估计parse_obj_file_pipelined之后的内存
+ * @details Specifications: \n
+ *  (1) 每个group的vertices数量估计为min(该group的face顶点引用数, 该group内定义的v行数量), 该group内没有v行时使用此前所有v行的数量.
+ *      所以对于各group顶点互不共享的常见obj文件, 估计值接近实际值, 否则偏大 \n
+ *  (2) 假设每条HEdge恰好有一条pair (闭合流形) \n
+ *  (3) SPATIAL_SPLIT的BVH节点数量按max_reference_growth的上限估计 \n
+ *  (4) peak_bytes是parse_obj_file_pipelined加载过程中的峰值, 按最坏情况估计: 全部常驻数据, 文件内容, vertices数组,
+ *      所有groups的faces索引(构建比解析慢时都会积压在队列中), 再加上num_threads个临时内存最大的groups同时构建
+ *      (load_data_to_model和calc_pairs的索引表, optimize_layout时optimize_model_layout的新旧两份几何数据, 或BVH构建的图元引用和节点数组,
+ *      取最大者) \n
+ *  (5) estimate->allocator和峰值中的临时内存都按allocation_overhead计入每次new的开销; 哈希表按libstdc++的节点和桶数组估计 \n
+ *  (6) 不包括线程栈, ThreadPool的任务队列, 以及进程本身(代码, 标准库, 未归还给系统的空闲内存)的常驻内存.
+ *      所以与进程的最大常驻内存(max RSS)比较时, 应先减去不加载模型时的常驻内存
+ *
+ * @param obj_path (Not Free)
+ * @param bvh_options (Not Free) 如果为nullptr, 不估计BVH
+ * @param num_threads 加载时的构建线程数量, 同parse_obj_file_pipelined. 小于1时使用std::thread::hardware_concurrency()
+ * @param optimize_layout 同parse_obj_file_pipelined
+ * @param estimate (Not Free) 输出, 加载后常驻内存的估计值
+ * @param peak_bytes (Not Free) 输出, 加载过程中内存峰值的估计值 (如果为nullptr, 自动忽略)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] obj_path == nullptr \n
+ *  [2] estimate == nullptr \n
+ *  [3] 无法读取obj文件
+ */
+int estimate_obj_footprint(const char *obj_path, const BVHBuildOptions *bvh_options, int num_threads, bool optimize_layout,
+                           MemoryFootprint *estimate, uint64_t *peak_bytes);
+
+#endif // __FOOTPRINT_H__
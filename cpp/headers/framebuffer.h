@@ -0,0 +1,93 @@
+/**
+ * @file framebuffer.h
+ * @brief 实现按tile存放的浮点累加framebuffer
+ * @details 像素按8 x 8的tile连续存放, 每个tile恰好占用16条64字节的cache line, 且tile起始地址64字节对齐.
+ *  所以只要各线程渲染的区域按8像素对齐(例如32 x 32的渲染tile), 它们写入的cache line互不重叠, 不会产生false sharing.
+ */
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief (Has Pointer) 浮点RGBA累加framebuffer
+ * @details 有两层数据: \n
+ *  (1) pixels: 每个像素的RGB之和以及权重之和(A). 只能由负责该像素的线程用add写入, 不加锁也不使用原子操作 \n
+ *  (2) splats: 落在当前线程负责区域之外的贡献(例如light tracing), 任意线程都可以用splat无锁地原子累加 \n
+ *  最终颜色 = pixels.rgb / pixels.a + splats.rgb * splat_scale, 由resolve_framebuffer计算.
+ *  使用前必须调用init_framebuffer, 使用后调用free_framebuffer.
+ */
+class Framebuffer {
+public:
+    static const int TILE_SIZE = 8;                       // tile边长(像素)
+    static const int TILE_PIXELS = TILE_SIZE * TILE_SIZE; // 每个tile的像素数量
+    static const int ALIGNMENT = 64;                      // cache line大小
+
+    int width = 0;
+    int height = 0;
+    int num_tiles_x = 0;                  // number of tiles along x
+    int num_tiles_y = 0;                  // number of tiles along y
+    float *pixels = nullptr;              // 每个像素4个float: R, G, B之和以及权重之和
+    std::atomic<float> *splats = nullptr; // 每个像素4个float: R, G, B之和, 第4个不使用
+
+    /**
+     * @brief 像素(x, y)在pixels和splats中的下标 (以像素为单位)
+     */
+    size_t pixel_index(int x, int y) const {
+        size_t tile = (size_t)(y / TILE_SIZE) * num_tiles_x + x / TILE_SIZE;
+        return tile * TILE_PIXELS + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+    }
+
+    /**
+     * @brief 把颜色(r, g, b)按weight累加到像素(x, y). r, g, b已经乘过weight. 只能由负责该像素的线程调用
+     */
+    void add(int x, int y, float r, float g, float b, float weight) {
+        float *p = pixels + pixel_index(x, y) * 4;
+        p[0] += r;
+        p[1] += g;
+        p[2] += b;
+        p[3] += weight;
+    }
+
+    /**
+     * @brief 把颜色(r, g, b)无锁地原子累加到像素(x, y)的splat层, 任意线程可以并发调用
+     */
+    void splat(int x, int y, float r, float g, float b);
+};
+
+/**
+ * @brief 为width x height的画面分配并清零fb的数据. 如果fb已有数据, 先释放.
+ *
+ * @param fb (Sub Free)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] fb == nullptr \n
+ *  [2] width或height不是正数
+ */
+int init_framebuffer(Framebuffer *fb, int width, int height);
+
+/**
+ * @brief 释放fb的数据, 并把fb恢复为未初始化状态
+ *
+ * @param fb (Sub Free) 如果是nullptr, 不做任何事
+ */
+void free_framebuffer(Framebuffer *fb);
+
+/**
+ * @brief 把fb转换为行优先的8位RGB图像, 可直接交给write_ppm
+ * @details 每个通道: color = pixels.rgb / pixels.a (权重为0时为0) + splats.rgb * splat_scale, 截断到[0, 1]后量化为0~255 (四舍五入).
+ *  调用时不能有其它线程正在写入fb. 每次处理一个tile, 支持SSE2时每次处理4个像素, 否则使用结果相同的标量代码.
+ *
+ * @param fb (Not Free)
+ * @param splat_scale splats的缩放系数, 例如light tracing的1 / 路径数量
+ * @param buffer (Not Free) 至少width * height * 3字节
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] fb或buffer是nullptr \n
+ *  [2] fb未初始化
+ */
+int resolve_framebuffer(const Framebuffer *fb, float splat_scale, uint8_t *buffer);
+
+#endif // __FRAMEBUFFER_H__
@@ -5,6 +5,8 @@
 #ifndef __HITRECORD_H__
 #define __HITRECORD_H__
 
+#include <eigen3/Eigen/Eigen>
+
 /**
  * @brief (Has Pointer)
  */
@@ -12,6 +14,7 @@ class HitRecord {
 public:
     bool hit;
     float t;
+    Eigen::Vector3f normal = Eigen::Vector3f::Zero(); // 交点处的几何法线(单位向量), 方向不保证朝向射线
 
     HitRecord(bool hit, float t) : hit(hit), t(t) {}
 };
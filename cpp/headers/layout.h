@@ -0,0 +1,33 @@
+/**
+ * @file layout.h
+ * @brief 实现Model的内存布局优化 (顶点焊接, face重排, vertex重编号)
+ */
+#ifndef __LAYOUT_H__
+#define __LAYOUT_H__
+
+#include <modeling.h>
+
+/**
+ * @brief 优化model的内存布局, 使空间上相邻的faces和它们使用的vertices在内存中也相邻
+ * @details 依次执行: \n
+ *  (1) 焊接: 坐标每个分量的差都不超过weld_epsilon的vertices合并为一个vertex (保留先出现的那个) \n
+ *  (2) face重排: 以face中心在model包围盒内的Morton码(Z-order曲线)为键, 稳定排序model->faces \n
+ *  (3) vertex重编号: 按重排后faces的顺序, 以首次被HEdge使用的顺序为vertices重新编号, 未被使用且未被焊接的vertices排在最后 \n
+ *  (4) 修正所有HEdge::v, HEdge::f, Face::index, Vertex::index \n
+ *  (5) 按重排后faces的顺序重新分配每个HEdge和它的pairs数组, 并修正HEdge::next, HEdge::prev, HEdge::pairs, Face::h, Vertex::h \n
+ *  (6) 如果发生了焊接, 调用calc_pairs(model, false)补齐新产生的pairs, 已有的pairs保持不变 \n
+ *  调用之后, 所有指向model中Vertex, Face, HEdge的外部指针都会失效.
+ *  焊接可能使一条HEdge的首尾变为同一个vertex, 这种退化的HEdge会被保留.
+ * @param model (Sub Free) model->verts, model->faces, 所有HEdge及其pairs都会被释放并重新分配
+ * @param weld_epsilon 焊接阈值. 小于0时不焊接, 等于0时只焊接坐标完全相同的vertices
+ * @param recursive 是否递归处理model->submodels
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] Face loop is broken, 或HEdge::v不属于model->verts \n
+ *  [3] calc_pairs失败 \n
+ *  [100+i] 递归第i个(从0开始)子模型时出现错误
+ */
+int optimize_model_layout(Model *model, float weld_epsilon, bool recursive);
+
+#endif // __LAYOUT_H__
@@ -0,0 +1,129 @@
+/**
+ * @file lazyload.h
+ * @brief 实现obj文件中submodels的按需加载 (out-of-core), 常驻内存不超过给定预算
+ */
+#ifndef __LAZYLOAD_H__
+#define __LAZYLOAD_H__
+
+#include <collider.h>
+#include <cstdint>
+#include <hitrecord.h>
+#include <modeling.h>
+#include <ray.h>
+#include <vector>
+
+/**
+ * @brief (Has Pointer) 按需加载的场景, 内部数据只在lazyload.cpp中可见
+ */
+class LazyScene;
+
+/**
+ * @brief 扫描obj文件, 只记录每个submodel的字节范围和AABB, 不加载几何数据
+ * @details Specifications: \n
+ *  (1) 每个o/g都成为model->submodels中的一个ModelList, 其model只有name, 没有vertices和faces \n
+ *  (2) 不属于任一group/object的faces成为一个名为"root"的submodel, model本身不包含几何数据 \n
+ *  (3) ModelList::user_data由scene管理, 调用方不能修改 \n
+ *  (4) 扫描时每个vertex暂时占用12字节用于计算AABB, 扫描结束后释放; 之后每1024个vertices常驻8字节的文件偏移索引 \n
+ *  (5) 加载一个submodel时会依次执行load_data_to_model, optimize_model_layout(不焊接, 仅当optimize_layout为true), calc_pairs和build_model_bvh \n
+ *  (6) 在scene被释放前, obj文件不能被修改 \n
+ *  (7) 扫描失败时, model中的数据可能会被污染 \n
+ *  (8) 每个已加载submodel的内存按model_footprint统计, 不包括扫描后一直常驻的name
+ * @param obj_path (Not Free) obj文件路径
+ * @param memory_budget 所有已加载submodels的内存估计值的上限(字节). 正在被使用的submodels不会被卸载, 所以实际占用可能暂时超出预算
+ * @param optimize_layout 同prepare_model
+ * @param model (Not Free) Objects的根节点
+ * @param scene (Not Free) 输出, 新建的LazyScene (Allocate Ret), 需要调用free_lazy_scene释放
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] obj_path == nullptr \n
+ *  [2] model == nullptr \n
+ *  [3] scene == nullptr \n
+ *  [4] 无法打开obj文件 \n
+ *  [5] 解析顶点坐标失败 \n
+ *  [6] 解析face失败 \n
+ *  [7] face引用了不存在的vertex, 或引用了在该face之后才定义的vertex
+ */
+int lazy_load_obj(const char *obj_path, uint64_t memory_budget, bool optimize_layout, Model *model, LazyScene **scene);
+
+/**
+ * @brief 获得model_list->model的完整数据. 如果尚未加载, 从obj文件加载. 之后model_list->model被锁定在内存中, 直到调用lazy_release.
+ * @details 线程安全. 多个线程可以同时acquire同一个或不同的submodels.
+ *
+ * @param scene (Not Free)
+ * @param model_list (Not Free) 必须是lazy_load_obj产生的ModelList
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] scene == nullptr \n
+ *  [2] model_list == nullptr或不属于scene \n
+ *  [3] 无法打开obj文件 \n
+ *  [4] 读取obj文件失败 (文件在lazy_load_obj之后被修改) \n
+ *  [5] load_data_to_model失败 \n
+ *  [6] optimize_model_layout失败 \n
+ *  [7] build_model_bvh失败 \n
+ *  [100+i] 100 + calc_pairs的状态码 \n
+ *  加载失败时submodel保持未加载状态, 已分配的几何数据和BVH会被释放
+ */
+int lazy_acquire(LazyScene *scene, ModelList *model_list);
+
+/**
+ * @brief 解除lazy_acquire的锁定. 每次成功的lazy_acquire必须对应一次lazy_release. 线程安全.
+ * @details 如果常驻内存超出预算, 会卸载最久未使用且未被锁定的submodels
+ *
+ * @param scene (Sub Free) 可能会卸载其中的submodels
+ * @param model_list (Not Free)
+ */
+void lazy_release(LazyScene *scene, ModelList *model_list);
+
+/**
+ * @brief 对AABB可能与frustum相交的每个submodel调用一次lazy_acquire, 把锁定的ModelLists追加到pinned. 线程安全.
+ * @details 用于按tile批量求交: 每个tile锁定一次, 之后tile内的射线直接遍历pinned中的model->bvh, 不再加锁,
+ *  LRU时钟也只在锁定时前进一次. 与frustum相交的submodels都会被锁定, 所以一个tile内的常驻内存可能超出预算.
+ *
+ * @param scene (Sub Free) 可能会加载其中的submodels
+ * @param pinned (Not Free) 成功时需要调用lazy_release_all解除锁定
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] scene == nullptr \n
+ *  [2] pinned == nullptr \n
+ *  [1000+i] 1000 + lazy_acquire的状态码, 本次调用锁定的submodels已被解除锁定
+ */
+int lazy_acquire_frustum(LazyScene *scene, const Frustum &frustum, std::vector<ModelList *> *pinned);
+
+/**
+ * @brief 对pinned中的每个ModelList调用lazy_release, 然后清空pinned. 线程安全.
+ * @param scene (Sub Free) 可能会卸载其中的submodels
+ * @param pinned (Not Free)
+ */
+void lazy_release_all(LazyScene *scene, std::vector<ModelList *> *pinned);
+
+/**
+ * @brief Ray与场景求交, 返回[t0, t1]内最近的交点. 线程安全.
+ * @details 只有AABB与ray相交的submodels才会被加载. 求交期间submodel被锁定, 求交结束后解除锁定.
+ *  每条射线都要对每个相交的submodel加锁并推进LRU时钟, 只适合零散的查询; 大量射线应使用lazy_acquire_frustum按tile锁定.
+ *
+ * @param scene (Sub Free) 可能会加载或卸载其中的submodels
+ * @param hit_record (Not Free) 最近交点的数据 (如果为nullptr, 自动忽略)
+ * @return true 相交
+ * @return false 不相交或加载失败
+ */
+bool lazy_ray_hit(LazyScene *scene, const Ray &ray, float t0, float t1, HitRecord *hit_record);
+
+/**
+ * @brief 当前已加载的submodels的内存估计值(字节)
+ * @param scene (Not Free) 如果是nullptr, 返回0
+ */
+uint64_t lazy_resident_bytes(const LazyScene *scene);
+
+/**
+ * @brief 卸载scene中所有submodels的几何数据并释放scene. 调用时不能有submodel被锁定.
+ * @details lazy_load_obj中的model, model->submodels以及submodels的name不会被释放, 但ModelList::user_data会被置为nullptr
+ *
+ * @param scene (Definite Free)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] scene == nullptr \n
+ *  [2] 有submodel仍被锁定, scene没有被释放
+ */
+int free_lazy_scene(LazyScene *scene);
+
+#endif // __LAZYLOAD_H__
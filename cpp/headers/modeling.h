@@ -6,9 +6,11 @@
 #define __MODELING_H__
 #include <cstdint>
 #include <eigen3/Eigen/Eigen>
+#include <vector>
 
 class Vertex;
 class Face;
+class ModelBVH;
 
 /**
  * @brief (Has Pointer) Half edge. Each edge is local to some Face.
@@ -74,7 +76,7 @@ public:
     Model *model = nullptr;
     Eigen::Matrix3f rotation = Eigen::Matrix3f::Identity();
     Eigen::Vector3f translation = Eigen::Vector3f::Zero();
-    void *user_data;
+    void *user_data = nullptr;
 };
 
 /**
@@ -88,6 +90,7 @@ public:
     uint32_t num_verts = 0; // number of vertices
     uint32_t num_faces = 0; // number of faces
     ModelList *submodels = nullptr;
+    ModelBVH *bvh = nullptr; // bottom-level bounding volume hierarchy of faces, 见bvh.h
 };
 
 /**
@@ -124,12 +127,98 @@ int add_submodel(Model *model, Model *submodel);
  *  [6] 解析face顶点属性失败 \n
  *  [7] face顶点属性超出int表达范围 \n
  *  [8] 一个f开头的行中vertex包含的属性少于一个 \n
- *  [9] 将obj数据转换至Model数据时发生错误
+ *  [9] 将obj数据转换至Model数据时发生错误 (例如face引用了不存在的顶点)
  *  [10] 一个face不足3个顶点
  *  [100+i] 100 + calc_paris的状态码
  */
 int parse_obj(const char *obj_file, Model *model);
 
+/**
+ * @brief 读取obj文件并调用parse_obj解析为Model
+ *
+ * @param obj_path (Not Free) obj文件路径
+ * @param model (Not Free) Objects的根节点
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] obj_path是nullptr \n
+ *  [2] model是nullptr \n
+ *  [1000] 无法打开或读取obj文件 \n
+ *  [其它] parse_obj的状态码
+ */
+int parse_obj_file(const char *obj_path, Model *model);
+
+/**
+ * @brief 解析obj文件中以"v "开头的一行
+ *
+ * @param line (Not Free) 以"v "开头, 以null character结尾的一行
+ * @param co (Not Free) 解析得到的顶点坐标 (已除以w)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] line == nullptr \n
+ *  [2] co == nullptr \n
+ *  [3] 解析顶点坐标失败: 一行的顶点坐标数量不足 \n
+ *  [4] 解析顶点坐标失败: 顶点坐标超过IEEE745三十二位浮点数范围
+ */
+int parse_obj_v_line(const char *line, Eigen::Vector3f *co);
+
+/**
+ * @brief 解析obj文件中以"f "开头的一行
+ *
+ * @param line (Not Free) 以"f "开头, 以null character结尾的一行
+ * @param face (Not Free) 解析得到的[v/vt/n, v/vt/n, ..., v/vt/n]会追加到face末尾; 索引从0开始; 如果vt, n不存在, 用-1代替
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] line == nullptr \n
+ *  [2] face == nullptr \n
+ *  [5] vertex包含多于3个属性 \n
+ *  [6] 解析face顶点属性失败 \n
+ *  [7] face顶点属性超出int表达范围 \n
+ *  [8] vertex包含的属性少于一个 \n
+ *  [10] face不足3个顶点
+ */
+int parse_obj_f_line(const char *line, std::vector<Eigen::Vector3i> *face);
+
+/**
+ * @brief 从verts和faces搜集Model数据, 加载至m
+ *
+ * @details 只读取faces用到的verts, 所以其它线程可以同时写入verts中未被faces引用的元素
+ *
+ * @param m (Not Free) 待加载的模型
+ * @param verts (Not Free) Vertices, 共num_verts个. num_verts为0时可以是nullptr
+ * @param faces (Not Free) [[v/vt/n, v/vt/n, ..., v/vt/n], [v/vt/n, v/vt/n, ..., v/vt/n], ...]; 索引从0开始; 如果vt, n不存在, 用-1代替
+ * @return int 状态码: \n
+ *  [0] succeeded \n
+ *  [1] m == nullptr \n
+ *  [2] verts == nullptr且num_verts > 0 \n
+ *  [3] faces == nullptr \n
+ *  [4] faces中的顶点索引不在[0, num_verts)内, m不会被修改
+ */
+int load_data_to_model(Model *m, const Vertex *verts, uint32_t num_verts, const std::vector<std::vector<Eigen::Vector3i>> *faces);
+
+/**
+ * @brief 释放model的vertices, faces, 所有HEdge及其pairs, 并把num_verts, num_faces置0
+ * @details model->name, model->submodels, model->bvh不会被释放. 如果model->bvh不为nullptr, 应先调用free_model_bvh.
+ *
+ * @param model (Sub Free)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] Face loop is broken
+ */
+int clear_model(Model *model);
+
+/**
+ * @brief 递归释放model的几何数据, name, 所有submodels及其ModelList. model本身不会被释放, 其成员恢复为初始值.
+ * @details 如果树中有Model的bvh不为nullptr, 应先调用free_model_bvh(model, true).
+ *
+ * @param model (Sub Free)
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] Face loop is broken
+ */
+int free_model_tree(Model *model);
+
 /**
  * @brief 计算model->faces中HEdge缺失的pairs
  *
@@ -0,0 +1,87 @@
+/**
+ * @file netio.h
+ * @brief 实现socket地址解析以及按行/按字节的阻塞读写 (仅POSIX)
+ */
+#ifndef __NETIO_H__
+#define __NETIO_H__
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief 在address上创建监听socket
+ * @details address格式: \n
+ *  (1) "unix:<path>": Unix domain socket. 如果path已是一个没有进程监听的socket(上次异常退出遗留), 会先被删除;
+ *      path是其它类型的文件或仍有进程在监听时返回失败, 不会删除 \n
+ *  (2) "tcp:<host>:<port>": TCP socket, host可以是IP地址或主机名
+ * @param address (Not Free)
+ * @param fd (Not Free) 输出, 监听socket的文件描述符
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] address或fd是nullptr \n
+ *  [2] address格式错误或无法解析 \n
+ *  [3] 创建, 绑定或监听socket失败 \n
+ *  [4] 当前平台不支持 \n
+ *  [5] unix path已存在且不是socket \n
+ *  [6] unix path上已有进程在监听
+ */
+int listen_address(const char *address, int *fd);
+
+/**
+ * @brief 连接到address, 格式同listen_address. TCP连接会开启enable_keepalive
+ * @param address (Not Free)
+ * @param fd (Not Free) 输出, 已连接socket的文件描述符
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] address或fd是nullptr \n
+ *  [2] address格式错误或无法解析 \n
+ *  [3] 连接失败 \n
+ *  [4] 当前平台不支持
+ */
+int connect_address(const char *address, int *fd);
+
+/**
+ * @brief 如果address是"unix:<path>"且path是socket, 删除path. 其它类型的文件不会被删除
+ * @param address (Not Free)
+ */
+void unlink_address(const char *address);
+
+/**
+ * @brief 开启SO_KEEPALIVE. 对于TCP连接, 空闲10秒后开始探测, 每5秒一次, 连续3次无响应时连接被视为断开, 之后的读写返回失败
+ * @details 用于发现已断电或网络中断的对端, 这种情况下对端不会关闭连接, 读操作会一直阻塞. 失败时忽略
+ */
+void enable_keepalive(int fd);
+
+/**
+ * @brief 读取一行(不含'\n', 去掉行尾的'\r'). 连接关闭, 出错或超过max_length时返回false
+ * @param line (Not Free) 读取的内容会追加到line末尾
+ */
+bool recv_line(int fd, std::string *line, size_t max_length);
+
+/**
+ * @brief 与recv_line相同, 但到达deadline时仍未读完一行也返回false
+ * @details 每次recv之前按剩余时间poll, 所以对端即使不断发送少量数据, 也不能把读取推迟到deadline之后
+ * @param line (Not Free) 读取的内容会追加到line末尾
+ */
+bool recv_line_before(int fd, std::string *line, size_t max_length, std::chrono::steady_clock::time_point deadline);
+
+/**
+ * @brief 读取恰好size字节. 连接关闭或出错时返回false
+ * @param data (Not Free)
+ */
+bool recv_all(int fd, void *data, size_t size);
+
+/**
+ * @brief 与recv_all相同, 但到达deadline时仍未读完也返回false. 超时规则同recv_line_before
+ * @param data (Not Free)
+ */
+bool recv_all_before(int fd, void *data, size_t size, std::chrono::steady_clock::time_point deadline);
+
+/**
+ * @brief 写入全部size字节. 出错时返回false. 不会产生SIGPIPE.
+ * @param data (Not Free)
+ */
+bool send_all(int fd, const void *data, size_t size);
+
+#endif // __NETIO_H__
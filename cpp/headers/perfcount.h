@@ -0,0 +1,47 @@
+/**
+ * @file perfcount.h
+ * @brief 用Linux perf_event_open统计调用线程的硬件事件(指令数, cache misses), 供benchmark输出
+ * @details 其它平台, 没有PMU的虚拟机, 或perf_event_paranoid不允许时打开失败, 调用方应输出"n/a"
+ */
+#ifndef __PERFCOUNT_H__
+#define __PERFCOUNT_H__
+
+#include <cstdint>
+
+/**
+ * @brief (No Pointer) 一个已打开的计数器
+ */
+class PerfCounter {
+public:
+    static const int INSTRUCTIONS = 0; // 退休的指令数
+    static const int CACHE_MISSES = 1; // 最后一级cache的misses
+
+    int fd = -1; // -1表示不可用
+};
+
+/**
+ * @brief 打开event计数器并开始计数, 只统计调用线程在用户态的事件
+ * @param counter (Not Free) 输出, 失败时counter->fd为-1
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] counter == nullptr \n
+ *  [2] event不是PerfCounter中的常量 \n
+ *  [3] 当前平台或权限不支持
+ */
+int open_perf_counter(int event, PerfCounter *counter);
+
+/**
+ * @brief 读取从打开到现在的计数
+ * @param counter (Not Free)
+ * @param value (Not Free) 输出
+ * @return 计数器可用且读取成功时返回true
+ */
+bool read_perf_counter(const PerfCounter *counter, uint64_t *value);
+
+/**
+ * @brief 关闭计数器. counter->fd为-1时什么也不做
+ * @param counter (Not Free)
+ */
+void close_perf_counter(PerfCounter *counter);
+
+#endif // __PERFCOUNT_H__
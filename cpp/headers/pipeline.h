@@ -0,0 +1,38 @@
+/**
+ * @file pipeline.h
+ * @brief 实现流水线式的场景加载: 解析obj文件的同时, 在线程池中构建已解析完的objects/groups
+ */
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <modeling.h>
+
+/**
+ * @brief 读取并解析obj文件, 结果与parse_obj_file之后再prepare_model(使用相同的optimize_layout)相同
+ * @details Specifications: \n
+ *  (1) 支持的obj格式与parse_obj相同, 得到的model树(包括submodels的顺序和名字)也相同 \n
+ *  (2) 解析前先扫描一遍文件统计"v "行的数量, 一次分配全部vertices, 解析过程中vertices的地址不变 \n
+ *  (3) 每解析完一个object/group(遇到下一个"o "/"g "行或文件结束), 就把它提交给线程池, 依次执行load_data_to_model, calc_pairs,
+ *      optimize_model_layout(不焊接, 仅当optimize_layout为true)和build_model_bvh_with_options(SPATIAL_SPLIT), 均不递归 \n
+ *  (4) 提交时只有已解析的顶点对该object/group可见, 所以face只能引用在object/group结束前定义的顶点 (同parse_obj), 否则返回[9] \n
+ *  (5) 各object/group互不共享数据, 所以构建结果与线程数量和完成顺序无关 \n
+ *  (6) 失败时仍会等待已提交的任务完成, model中的数据可能会被污染 (同parse_obj), 应调用free_model_bvh和free_model_tree释放
+ * @param obj_path (Not Free) obj文件路径
+ * @param model (Not Free) Objects的根节点
+ * @param num_threads 构建线程数量(解析在调用线程中进行). 小于1时使用std::thread::hardware_concurrency()
+ * @param optimize_layout 同prepare_model
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] obj_path是nullptr \n
+ *  [2] model是nullptr \n
+ *  [3]-[8], [10] 同parse_obj \n
+ *  [9] load_data_to_model失败 \n
+ *  [11] optimize_model_layout失败 \n
+ *  [12] build_model_bvh_with_options失败 \n
+ *  [100+i] 100 + calc_pairs的状态码 \n
+ *  [1000] 无法打开或读取obj文件 \n
+ *  多个object/group失败时, 返回文件中最靠前的那个的状态码
+ */
+int parse_obj_file_pipelined(const char *obj_path, Model *model, int num_threads, bool optimize_layout);
+
+#endif // __PIPELINE_H__
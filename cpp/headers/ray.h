@@ -7,6 +7,7 @@
 
 #include <cmath>
 #include <eigen3/Eigen/Eigen>
+#include <simdmath.h>
 
 /**
  * @brief (No Pointer)
@@ -22,4 +23,39 @@ public:
     Eigen::Vector3f at(float t) { return o + t * d; }
 };
 
+/**
+ * @brief (No Pointer) 求交内核使用的Ray: 每条射线计算一次, 之后与每个AABB, 三角形求交时复用
+ * @details 三角形求交使用Woop, Benthin, Wald 2013的watertight算法: 把射线方向最大的分量kz作为z轴,
+ *  剪切变换后射线变为沿+z的单位射线, 三角形边函数只依赖顶点, 所以共享边上的交点不会同时被相邻三角形漏掉.
+ */
+class PrecomputedRay {
+public:
+    Ray ray;                    // 原始射线
+    Float4 o;                   // origin, w = 0
+    Float4 inv_d;               // 1 / direction, w = 0. 分量为0时是±inf
+    Float4 shear;               // (d[kx] / d[kz], d[ky] / d[kz], 1 / d[kz], 0)
+    int kx = 0;                 // 剪切后的x轴
+    int ky = 1;                 // 剪切后的y轴
+    int kz = 2;                 // |d|最大的轴
+    bool axis_parallel = false; // direction有为0的分量, slab test需要单独处理
+
+    PrecomputedRay(const Ray &ray) : ray(ray) {
+        const Eigen::Vector3f &d = ray.d;
+        o = float4_from_vector3(ray.o);
+        inv_d = Float4(1.0f / d[0], 1.0f / d[1], 1.0f / d[2], 0);
+        axis_parallel = d[0] == 0 || d[1] == 0 || d[2] == 0;
+        Eigen::Vector3f abs_d = d.cwiseAbs();
+        kz = abs_d[0] > abs_d[1] ? (abs_d[0] > abs_d[2] ? 0 : 2) : (abs_d[1] > abs_d[2] ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (d[kz] < 0) {
+            // 保持三角形的环绕方向
+            int temp = kx;
+            kx = ky;
+            ky = temp;
+        }
+        shear = Float4(d[kx] / d[kz], d[ky] / d[kz], 1.0f / d[kz], 0);
+    }
+};
+
 #endif // __RAY_H__
\ No newline at end of file
@@ -0,0 +1,169 @@
+/**
+ * @file render.h
+ * @brief 实现相机和primary ray渲染
+ */
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <bvh.h>
+#include <collider.h>
+#include <cstdint>
+#include <eigen3/Eigen/Eigen>
+#include <framebuffer.h>
+#include <hitrecord.h>
+#include <lazyload.h>
+#include <modeling.h>
+#include <ray.h>
+#include <sampler.h>
+#include <vector>
+
+/**
+ * @brief (No Pointer) 针孔相机
+ */
+class Camera {
+public:
+    Eigen::Vector3f eye = Eigen::Vector3f(0, 0, 5);   // 相机位置
+    Eigen::Vector3f target = Eigen::Vector3f::Zero(); // 相机看向的点
+    Eigen::Vector3f up = Eigen::Vector3f(0, 1, 0);    // 大致的上方向, 不能与target - eye平行
+    float fov = 45;                                   // field of view, 竖直方向视角(角度)
+
+    /**
+     * @brief 生成经过胶片上(u, v)的射线. u从左到右, v从上到下, 胶片范围是[0, 1] x [0, 1]
+     * @param aspect 宽 / 高
+     */
+    Ray generate_ray(float u, float v, float aspect) const;
+
+    /**
+     * @brief 包含胶片上[u0, u1] x [v0, v1]内所有射线的frustum: 4个侧面和过eye的近平面
+     */
+    Frustum frustum(float u0, float v0, float u1, float v1, float aspect) const;
+};
+
+/**
+ * @brief (Has Pointer) model树中一个Model在某个frustum内的候选子树
+ */
+class TileCandidateModel {
+public:
+    Eigen::Matrix3f rotation = Eigen::Matrix3f::Identity(); // Model空间到根模型空间的旋转 (各级ModelList::rotation的乘积)
+    Eigen::Vector3f translation = Eigen::Vector3f::Zero();  // Model空间到根模型空间的平移
+    uint32_t begin = 0;                                     // TileCandidates::nodes中的起始下标
+    uint32_t end = 0;                                       // TileCandidates::nodes中的结束下标(不含)
+};
+
+/**
+ * @brief (Has Pointer) model树在一个tile的frustum内的全部候选子树, 由cull_model_tile生成
+ */
+class TileCandidates {
+public:
+    std::vector<TileCandidateModel> models; // 至少有一个候选子树的Models
+    std::vector<const BVHTree *> nodes;     // 所有候选子树, 各Model的候选子树连续存放
+};
+
+/**
+ * @brief Ray与model树中所有Model::bvh求交, 返回[t0, t1]内最近的交点
+ * @details 子模型按ModelList::rotation和ModelList::translation变换到父模型空间 (rotation应为正交矩阵).
+ *  没有bvh的Model会被跳过.
+ *
+ * @param model (Not Free) 如果是nullptr, 返回false
+ * @param hit_record (Not Free) 最近交点的数据, normal在model空间中 (如果为nullptr, 自动忽略)
+ */
+bool model_ray_hit(const Model *model, const Ray &ray, float t0, float t1, HitRecord *hit_record);
+
+/**
+ * @brief 用frustum裁剪model树中所有Model::bvh, 结果写入candidates (原有内容会被清空)
+ * @details frustum在根模型空间中, 对每个子模型按ModelList的变换转换到子模型空间后调用bvh_frustum_cull.
+ *  没有候选子树的Model不会出现在candidates->models中.
+ *
+ * @param model (Not Free) 如果是nullptr, candidates为空
+ * @param candidates (Not Free)
+ */
+void cull_model_tile(const Model *model, const Frustum &frustum, TileCandidates *candidates);
+
+/**
+ * @brief Ray只与candidates中的候选子树求交, 返回[t0, t1]内最近的交点
+ * @details ray完全在生成candidates的frustum内时, 结果与model_ray_hit相同
+ *
+ * @param candidates (Not Free)
+ * @param hit_record (Not Free) 最近交点的数据, normal在根模型空间中 (如果为nullptr, 自动忽略)
+ */
+bool tile_ray_hit(const TileCandidates *candidates, const Ray &ray, float t0, float t1, HitRecord *hit_record);
+
+/**
+ * @brief 为model树做渲染前的准备: optimize_model_layout(不焊接)和build_model_bvh_with_options(SPATIAL_SPLIT), 均递归
+ * @details 重排并不总是更快: 在没有硬件计数器的机器上没有测到cache misses的减少, 而大场景(big.obj)的primary rays反而变慢,
+ *  所以默认不重排. 是否开启应以--layout-benchmark在目标场景上的结果为准
+ *
+ * @param model (Sub Free)
+ * @param optimize_layout 是否执行optimize_model_layout
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] optimize_model_layout失败 \n
+ *  [3] build_model_bvh_with_options失败
+ */
+int prepare_model(Model *model, bool optimize_layout);
+
+/**
+ * @brief 渲染画面中[x0, x1) x [y0, y1)的像素, 写入tile-local的RGB缓冲区
+ * @details 每个像素发射spp条在像素内抖动的primary rays. 被击中的点按法线与视线夹角着色, 未击中的像素为背景色.
+ *  第i条射线的抖动是sampler在(y * width + x, i)处第0, 1维的样本, 所以同一画面分成任意tiles渲染的结果相同.
+ *  渲染前先用tile的frustum裁剪一次BVH (cull_model_tile), 之后每条射线只遍历候选子树.
+ *
+ * @param model (Not Free) 已经过prepare_model的场景
+ * @param camera (Not Free)
+ * @param sampler (Not Free)
+ * @param width 整个画面的宽度
+ * @param height 整个画面的高度
+ * @param spp samples per pixel
+ * @param buffer (Not Free) 至少(x1 - x0) * (y1 - y0) * 3字节, 像素(x, y)写入buffer[((y - y0) * (x1 - x0) + (x - x0)) * 3]
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] camera == nullptr \n
+ *  [3] buffer == nullptr \n
+ *  [4] width, height或spp不是正数 \n
+ *  [5] tile范围不在画面内或为空 \n
+ *  [6] sampler == nullptr
+ */
+int render_tile(const Model *model, const Camera *camera, const Sampler *sampler, int width, int height, int spp, int x0, int y0,
+                int x1, int y1, uint8_t *buffer);
+
+/**
+ * @brief 与render_tile相同, 但把每个像素spp个样本的颜色之和按权重spp累加到fb, 画面大小为fb->width x fb->height
+ * @details 多个线程可以同时渲染互不重叠的tiles到同一个fb. tile边界按Framebuffer::TILE_SIZE对齐时, 各线程不会写入同一条cache line.
+ *  resolve_framebuffer得到的图像与用render_tile渲染整个画面的结果相同.
+ *
+ * @param fb (Not Free) 已经过init_framebuffer
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] model == nullptr \n
+ *  [2] camera == nullptr \n
+ *  [3] fb == nullptr或未初始化 \n
+ *  [4] spp不是正数 \n
+ *  [5] tile范围不在画面内或为空 \n
+ *  [6] sampler == nullptr
+ */
+int render_tile_to_framebuffer(const Model *model, const Camera *camera, const Sampler *sampler, int spp, int x0, int y0, int x1, int y1,
+                               Framebuffer *fb);
+
+/**
+ * @brief 与render_tile_to_framebuffer相同, 但场景是按需加载的LazyScene
+ * @details 渲染前用tile的frustum调用一次lazy_acquire_frustum, 锁定可能被击中的submodels, tile内的射线求交不再加锁,
+ *  渲染结束后调用lazy_release_all. 多个线程可以同时渲染同一个scene的不同tiles.
+ *
+ * @param scene (Sub Free) 可能会加载或卸载其中的submodels
+ * @param fb (Not Free) 已经过init_framebuffer
+ * @return 状态码: \n
+ *  [0] succeeded \n
+ *  [1] scene == nullptr \n
+ *  [2] camera == nullptr \n
+ *  [3] fb == nullptr或未初始化 \n
+ *  [4] spp不是正数 \n
+ *  [5] tile范围不在画面内或为空 \n
+ *  [6] sampler == nullptr \n
+ *  [100+i] 100 + lazy_acquire_frustum的状态码, fb没有被修改
+ */
+int render_lazy_tile_to_framebuffer(LazyScene *scene, const Camera *camera, const Sampler *sampler, int spp, int x0, int y0, int x1,
+                                    int y1, Framebuffer *fb);
+
+#endif // __RENDER_H__
@@ -0,0 +1,69 @@
+/**
+ * @file sampler.h
+ * @brief 实现采样器: 均匀随机, Owen-scrambled Sobol, 蓝噪声
+ * @details 所有采样器都是无状态的: 样本只由(pixel, index, dimension)和构造参数决定.
+ *  因此任意线程可以并发调用同一个采样器, 不需要加锁, 渲染结果也与线程数量和tile划分无关.
+ */
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include <cstdint>
+
+/**
+ * @brief (No Pointer) 采样器接口
+ */
+class Sampler {
+public:
+    virtual ~Sampler() {}
+
+    /**
+     * @brief 第pixel个像素的第index个样本在第dimension维的值
+     * @return [0, 1)内的浮点数
+     */
+    virtual float sample(uint32_t pixel, uint32_t index, uint32_t dimension) const = 0;
+};
+
+/**
+ * @brief (No Pointer) 由哈希函数生成的均匀随机样本, 用作对照
+ */
+class UniformSampler : public Sampler {
+public:
+    uint32_t seed = 0;
+
+    UniformSampler(uint32_t seed) : seed(seed) {}
+
+    float sample(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
+
+/**
+ * @brief (No Pointer) Owen-scrambled Sobol序列
+ * @details 每个像素使用独立的scramble. 维度每4个一组, 组内是Sobol序列的前4维,
+ *  不同组之间用不同的种子打乱样本顺序(shuffle), 所以任意维度都可用.
+ *  Owen scrambling保留Sobol序列的分层性质, 样本数为2的幂时收敛最快.
+ */
+class SobolSampler : public Sampler {
+public:
+    uint32_t seed = 0;
+
+    SobolSampler(uint32_t seed) : seed(seed) {}
+
+    float sample(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
+
+/**
+ * @brief (No Pointer) 蓝噪声采样器: 所有像素共享同一个Owen-scrambled Sobol序列, 每个像素每一维再按蓝噪声纹理做toroidal平移
+ * @details 相邻像素的误差互相错开, 低采样数时噪声集中在高频, 视觉上更平滑.
+ *  64 x 64的蓝噪声纹理在第一次构造时用void-and-cluster算法生成, 之后只读, 线程安全.
+ *  pixel按width换算成二维坐标, 以便纹理在画面上平铺.
+ */
+class BlueNoiseSampler : public Sampler {
+public:
+    uint32_t seed = 0;
+    uint32_t width = 1; // 画面宽度, 用于把pixel换算为(x, y)
+
+    BlueNoiseSampler(uint32_t seed, uint32_t width);
+
+    float sample(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
+
+#endif // __SAMPLER_H__
@@ -0,0 +1,164 @@
+/**
+ * @file simdmath.h
+ * @brief 实现求交内核使用的4通道浮点向量. 仅在内部使用, 对外接口仍使用Eigen
+ * @details 有SSE2时每个Float4是一个__m128, 否则是4个float, 两种实现的逐通道结果相同 (都不使用FMA).
+ *  三维向量用w = 0的Float4表示, 16字节对齐, 一条指令完成三个分量的运算.
+ */
+#ifndef __SIMDMATH_H__
+#define __SIMDMATH_H__
+
+#include <cstring>
+#include <eigen3/Eigen/Eigen>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief (No Pointer) 4通道浮点向量
+ */
+class alignas(16) Float4 {
+public:
+#ifdef __SSE2__
+    __m128 m = _mm_setzero_ps();
+#else
+    float m[4] = {0, 0, 0, 0};
+#endif
+
+    Float4() {}
+#ifdef __SSE2__
+    Float4(__m128 m) : m(m) {}
+    Float4(float x, float y, float z, float w) : m(_mm_setr_ps(x, y, z, w)) {}
+    explicit Float4(float s) : m(_mm_set1_ps(s)) {}
+
+    float operator[](int i) const {
+        alignas(16) float v[4];
+        _mm_store_ps(v, m);
+        return v[i];
+    }
+#else
+    Float4(float x, float y, float z, float w) : m{x, y, z, w} {}
+    explicit Float4(float s) : m{s, s, s, s} {}
+
+    float operator[](int i) const { return m[i]; }
+#endif
+};
+
+/**
+ * @brief 三维向量v, w = 0
+ */
+inline Float4 float4_from_vector3(const Eigen::Vector3f &v) {
+#ifdef __SSE2__
+    // 分别读取xy(8字节)和z(4字节), 不会读到v之后的内存. v只按4字节对齐, 所以xy用memcpy读取
+    double xy_bits;
+    memcpy(&xy_bits, v.data(), sizeof(double));
+    __m128 xy = _mm_castpd_ps(_mm_set_sd(xy_bits));
+    __m128 z = _mm_load_ss(v.data() + 2);
+    return _mm_movelh_ps(xy, z);
+#else
+    return Float4(v[0], v[1], v[2], 0);
+#endif
+}
+
+#ifdef __SSE2__
+inline Float4 operator+(const Float4 &a, const Float4 &b) { return _mm_add_ps(a.m, b.m); }
+inline Float4 operator-(const Float4 &a, const Float4 &b) { return _mm_sub_ps(a.m, b.m); }
+inline Float4 operator*(const Float4 &a, const Float4 &b) { return _mm_mul_ps(a.m, b.m); }
+inline Float4 operator/(const Float4 &a, const Float4 &b) { return _mm_div_ps(a.m, b.m); }
+
+/**
+ * @brief 逐通道的较小值. 有NaN时返回b的通道
+ */
+inline Float4 min(const Float4 &a, const Float4 &b) { return _mm_min_ps(a.m, b.m); }
+
+/**
+ * @brief 逐通道的较大值. 有NaN时返回b的通道
+ */
+inline Float4 max(const Float4 &a, const Float4 &b) { return _mm_max_ps(a.m, b.m); }
+
+/**
+ * @brief 第i位为1表示a[i] < b[i]
+ */
+inline int mask_lt(const Float4 &a, const Float4 &b) { return _mm_movemask_ps(_mm_cmplt_ps(a.m, b.m)); }
+
+/**
+ * @brief 第i位为1表示a[i] == b[i]
+ */
+inline int mask_eq(const Float4 &a, const Float4 &b) { return _mm_movemask_ps(_mm_cmpeq_ps(a.m, b.m)); }
+
+/**
+ * @brief 按通道下标重排: (a[i0], a[i1], a[i2], a[i3])
+ */
+template <int i0, int i1, int i2, int i3>
+inline Float4 shuffle(const Float4 &a) {
+    return _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(i3, i2, i1, i0));
+}
+
+/**
+ * @brief 以a, b, c为行的3 x 4矩阵转置: x = (a[0], b[0], c[0], 0), y, z同理
+ */
+inline void transpose3(const Float4 &a, const Float4 &b, const Float4 &c, Float4 *x, Float4 *y, Float4 *z) {
+    __m128 r0 = a.m, r1 = b.m, r2 = c.m, r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    x->m = r0;
+    y->m = r1;
+    z->m = r2;
+}
+#else
+inline Float4 operator+(const Float4 &a, const Float4 &b) {
+    return Float4(a.m[0] + b.m[0], a.m[1] + b.m[1], a.m[2] + b.m[2], a.m[3] + b.m[3]);
+}
+
+inline Float4 operator-(const Float4 &a, const Float4 &b) {
+    return Float4(a.m[0] - b.m[0], a.m[1] - b.m[1], a.m[2] - b.m[2], a.m[3] - b.m[3]);
+}
+
+inline Float4 operator*(const Float4 &a, const Float4 &b) {
+    return Float4(a.m[0] * b.m[0], a.m[1] * b.m[1], a.m[2] * b.m[2], a.m[3] * b.m[3]);
+}
+
+inline Float4 operator/(const Float4 &a, const Float4 &b) {
+    return Float4(a.m[0] / b.m[0], a.m[1] / b.m[1], a.m[2] / b.m[2], a.m[3] / b.m[3]);
+}
+
+inline Float4 min(const Float4 &a, const Float4 &b) {
+    return Float4(a.m[0] < b.m[0] ? a.m[0] : b.m[0], a.m[1] < b.m[1] ? a.m[1] : b.m[1], a.m[2] < b.m[2] ? a.m[2] : b.m[2],
+                  a.m[3] < b.m[3] ? a.m[3] : b.m[3]);
+}
+
+inline Float4 max(const Float4 &a, const Float4 &b) {
+    return Float4(a.m[0] > b.m[0] ? a.m[0] : b.m[0], a.m[1] > b.m[1] ? a.m[1] : b.m[1], a.m[2] > b.m[2] ? a.m[2] : b.m[2],
+                  a.m[3] > b.m[3] ? a.m[3] : b.m[3]);
+}
+
+inline int mask_lt(const Float4 &a, const Float4 &b) {
+    return (a.m[0] < b.m[0]) | (a.m[1] < b.m[1]) << 1 | (a.m[2] < b.m[2]) << 2 | (a.m[3] < b.m[3]) << 3;
+}
+
+inline int mask_eq(const Float4 &a, const Float4 &b) {
+    return (a.m[0] == b.m[0]) | (a.m[1] == b.m[1]) << 1 | (a.m[2] == b.m[2]) << 2 | (a.m[3] == b.m[3]) << 3;
+}
+
+template <int i0, int i1, int i2, int i3>
+inline Float4 shuffle(const Float4 &a) {
+    return Float4(a.m[i0], a.m[i1], a.m[i2], a.m[i3]);
+}
+
+inline void transpose3(const Float4 &a, const Float4 &b, const Float4 &c, Float4 *x, Float4 *y, Float4 *z) {
+    *x = Float4(a.m[0], b.m[0], c.m[0], 0);
+    *y = Float4(a.m[1], b.m[1], c.m[1], 0);
+    *z = Float4(a.m[2], b.m[2], c.m[2], 0);
+}
+#endif
+
+/**
+ * @brief 前三个通道的最大值
+ */
+inline float hmax3(const Float4 &a) { return max(max(a, shuffle<1, 1, 1, 1>(a)), shuffle<2, 2, 2, 2>(a))[0]; }
+
+/**
+ * @brief 前三个通道的最小值
+ */
+inline float hmin3(const Float4 &a) { return min(min(a, shuffle<1, 1, 1, 1>(a)), shuffle<2, 2, 2, 2>(a))[0]; }
+
+#endif // __SIMDMATH_H__
@@ -5,8 +5,10 @@
 #ifndef __SURFACE_H__
 #define __SURFACE_H__
 
-#include <ray.h>
+#include <algorithm>
 #include <hitrecord.h>
+#include <modeling.h>
+#include <ray.h>
 
 class AABB;
 
@@ -27,6 +29,13 @@ public:
      */
     virtual bool ray_hit(const Ray &ray, float t0, float t1, HitRecord *hit_record) const = 0;
 
+    /**
+     * @brief 与ray_hit相同, 但使用预先计算的射线数据. 默认实现调用ray_hit(ray.ray, ...)
+     */
+    virtual bool ray_hit_precomputed(const PrecomputedRay &ray, float t0, float t1, HitRecord *hit_record) const {
+        return ray_hit(ray.ray, t0, t1, hit_record);
+    }
+
     /**
      * @brief 获得该Surface的AABB
      *
@@ -49,6 +58,8 @@ public:
     AABB(float x_low, float x_high, float y_low, float y_high, float z_low, float z_high);
 
     /**
+     * @brief 用aabb_ray_slab求交, 相交时hit_record->t为射线进入AABB的t (不小于t0)
+     * @details 每次调用都要预计算1 / direction, 对同一条射线测试多个AABB时应直接调用aabb_ray_slab
      * @param hit_record (Not Free)
      */
     bool ray_hit(const Ray &ray, float t0, float t1, HitRecord *hit_record) const override;
@@ -59,6 +70,90 @@ public:
         auto v = p1 - p0;
         return v[0] * v[1] * v[2];
     }
+
+    float surface_area() const {
+        auto v = p1 - p0;
+        return 2 * (v[0] * v[1] + v[1] * v[2] + v[2] * v[0]);
+    }
+};
+
+/**
+ * @brief Ray是否与aabb在[t0, t1]内相交, 用预先计算的1 / direction做slab test
+ * @details 射线进入和离开aabb的t各用一条SIMD指令对三个轴同时计算. 离开的t乘以(1 + 2 * gamma(3))向外放宽,
+ *  所以舍入误差不会漏掉擦边的节点 (Ize 2013). 射线与某个轴平行时, 起点在该轴的slab内(含边界)则该轴不限制t, 否则不相交.
+ *
+ * @param t (Not Free) 相交时写入射线进入aabb的t, 不小于t0 (如果为nullptr, 自动忽略)
+ */
+inline bool aabb_ray_slab(const PrecomputedRay &ray, const AABB &aabb, float t0, float t1, float *t) {
+    Float4 t_a = (float4_from_vector3(aabb.p0) - ray.o) * ray.inv_d;
+    Float4 t_b = (float4_from_vector3(aabb.p1) - ray.o) * ray.inv_d;
+    Float4 enter = min(t_a, t_b);
+    Float4 exit = max(t_a, t_b);
+    if (ray.axis_parallel) {
+        // 该轴的inv_d是±inf, 起点恰好在slab边界上时t_a或t_b是NaN, 所以直接按起点是否在slab内决定
+        float e[3] = {enter[0], enter[1], enter[2]};
+        float x[3] = {exit[0], exit[1], exit[2]};
+        for (int axis = 0; axis < 3; axis++) {
+            if (ray.ray.d[axis] != 0)
+                continue;
+            if (ray.ray.o[axis] < aabb.p0[axis] || ray.ray.o[axis] > aabb.p1[axis])
+                return false;
+            e[axis] = -INFINITY;
+            x[axis] = INFINITY;
+        }
+        enter = Float4(e[0], e[1], e[2], 0);
+        exit = Float4(x[0], x[1], x[2], 0);
+    }
+    const float robust_scale = 1.0000004f; // 1 + 2 * gamma(3)
+    float t_enter = std::max(hmax3(enter), t0);
+    float t_exit = std::min(hmin3(exit) * robust_scale, t1);
+    if (t_enter > t_exit)
+        return false;
+    if (t != nullptr)
+        *t = t_enter;
+    return true;
+}
+
+/**
+ * @brief Watertight ray/triangle求交 (Woop, Benthin, Wald 2013), 不剔除背面
+ * @details 三个顶点的剪切变换和三个边函数各用一组SIMD指令同时计算. 边函数有0时用double重新计算,
+ *  所以射线恰好穿过共享边或顶点时, 相邻三角形中至少一个会相交.
+ *  保证: 共享边和顶点上不漏检, 渲染中不会出现漏光的裂缝. 代价: 比Moller-Trumbore多一次剪切变换和边函数的符号检查,
+ *  快慢取决于平台和编译器的向量化, 用--intersect-benchmark在目标机器上比较. 如果场景不需要这一保证, 可以换回Moller-Trumbore.
+ *
+ * @param t (Not Free) 相交时写入交点的t (如果为nullptr, 自动忽略)
+ * @return 是否在[t0, t1]内相交
+ */
+bool watertight_triangle_hit(const PrecomputedRay &ray, const Eigen::Vector3f &a, const Eigen::Vector3f &b, const Eigen::Vector3f &c,
+                             float t0, float t1, float *t);
+
+/**
+ * @brief (Has Pointer) 把Model中的一个Face当作Surface. 多边形以face->h->v为中心扇形三角化后求交.
+ */
+class FaceSurface : public Surface {
+public:
+    Face *face = nullptr;
+
+    FaceSurface() {}
+    FaceSurface(Face *face) : face(face) {}
+
+    /**
+     * @param hit_record (Not Free)
+     * @param face (Not Free)
+     */
+    bool ray_hit(const Ray &ray, float t0, float t1, HitRecord *hit_record) const override;
+
+    /**
+     * @brief 每个三角形用watertight_triangle_hit求交 (代价见watertight_triangle_hit), ray_hit也调用它
+     * @param hit_record (Not Free)
+     */
+    bool ray_hit_precomputed(const PrecomputedRay &ray, float t0, float t1, HitRecord *hit_record) const override;
+
+    /**
+     * @brief face的所有顶点的AABB. 如果face或face->h是nullptr, 返回AABB(0, 0, 0, 0, 0, 0)
+     * @param face (Not Free)
+     */
+    AABB aabb() const override;
 };
 
 #endif // __SURFACE_H__
\ No newline at end of file
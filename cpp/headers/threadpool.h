@@ -0,0 +1,50 @@
+/**
+ * @file threadpool.h
+ * @brief 实现固定线程数量的任务池
+ */
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief (Has Pointer) 线程池: 构造时创建线程, 任务按提交顺序(FIFO)被空闲线程取走执行
+ * @details submit和wait可以在任意线程调用, 但不能在任务内部调用wait. 任务不能抛出异常.
+ *  析构时先等待所有已提交的任务完成, 再结束线程.
+ */
+class ThreadPool {
+public:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks; // 等待执行的任务
+    int num_running = 0;                     // 正在执行的任务数量
+    bool stop = false;                       // 为true时线程在任务队列为空后退出
+    std::mutex lock;                         // 保护tasks, num_running, stop
+    std::condition_variable task_cv;         // 有新任务或stop
+    std::condition_variable idle_cv;         // tasks为空且num_running为0
+
+    /**
+     * @param num_threads 线程数量. 小于1时使用std::thread::hardware_concurrency()
+     */
+    ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief 提交一个任务
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief 阻塞直到所有已提交的任务完成
+     */
+    void wait();
+};
+
+#endif // __THREADPOOL_H__
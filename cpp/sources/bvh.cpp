@@ -2,4 +2,583 @@
  * @file bvh.cpp
  * @brief bvh.h的实现代码
  */
+#include <algorithm>
 #include <bvh.h>
+#include <cmath>
+#include <deque>
+
+using namespace std;
+
+bool aabb_a_lt_b_along_axis(const AABB &a, const AABB &b, int axis) {
+    if (axis < 0 || axis > 2)
+        return false;
+    return (a.p0[axis] + a.p1[axis]) < (b.p0[axis] + b.p1[axis]);
+}
+
+bool aabb_a_lt_b_along_x(const AABB &a, const AABB &b) { return aabb_a_lt_b_along_axis(a, b, 0); }
+
+bool aabb_a_lt_b_along_y(const AABB &a, const AABB &b) { return aabb_a_lt_b_along_axis(a, b, 1); }
+
+bool aabb_a_lt_b_along_z(const AABB &a, const AABB &b) { return aabb_a_lt_b_along_axis(a, b, 2); }
+
+/**
+ * @brief (Has Pointer) 构建BVH时的图元引用
+ */
+class BVHBuildItem {
+public:
+    AABB aabb = AABB(0, 0, 0, 0, 0, 0); // 图元引用的AABB. spatial split之后可能小于surface->aabb()
+    FaceSurface *surface = nullptr;
+};
+
+/**
+ * @brief 用items[begin, end)构建子树, 节点从nodes[*num_nodes]开始分配
+ *
+ * @param items (Not Free) 会被重新排列
+ * @param nodes (Not Free) 至少有2 * (end - begin) - 1个空闲节点
+ * @param num_nodes (Not Free) 已分配的节点数量
+ * @return 子树的根节点
+ */
+static BVHTree *build_median_split(vector<BVHBuildItem> *items, int begin, int end, BVHTree *nodes, uint32_t *num_nodes) {
+    BVHTree *node = nodes + (*num_nodes)++;
+    if (end - begin == 1) {
+        node->aabb = (*items)[begin].aabb;
+        node->surface = (*items)[begin].surface;
+        return node;
+    }
+    AABB bounds = (*items)[begin].aabb;
+    for (int i = begin + 1; i < end; i++) {
+        bounds = aabb_merge(bounds, (*items)[i].aabb);
+    }
+    Eigen::Vector3f extent = bounds.p1 - bounds.p0;
+    int axis = 0;
+    if (extent[1] > extent[axis])
+        axis = 1;
+    if (extent[2] > extent[axis])
+        axis = 2;
+    bool (*less)(const AABB &, const AABB &) = axis == 0 ? aabb_a_lt_b_along_x : (axis == 1 ? aabb_a_lt_b_along_y : aabb_a_lt_b_along_z);
+    int mid = (begin + end) / 2;
+    std::nth_element(items->begin() + begin, items->begin() + mid, items->begin() + end,
+                     [less](const BVHBuildItem &a, const BVHBuildItem &b) { return less(a.aabb, b.aabb); });
+    node->aabb = bounds;
+    node->left = build_median_split(items, begin, mid, nodes, num_nodes);
+    node->right = build_median_split(items, mid, end, nodes, num_nodes);
+    return node;
+}
+
+static const int MAX_SAH_DEPTH = 31; // SAH划分的最大深度, 之后改用中位数划分, 使树深度小于64
+
+/**
+ * @brief (Has Pointer) SAH / SBVH构建的全局状态
+ */
+class SAHBuildContext {
+public:
+    const BVHBuildOptions *options = nullptr;
+    BVHTree *nodes = nullptr;         // 所有节点
+    uint32_t num_nodes = 0;           // number of allocated nodes
+    int64_t remaining_references = 0; // spatial split还能增加的图元引用数量
+    float root_area = 0;              // 根节点AABB的表面积
+};
+
+/**
+ * @brief (No Pointer) SAH的一个bin
+ */
+class SAHBin {
+public:
+    AABB aabb = AABB(0, 0, 0, 0, 0, 0);
+    bool empty = true;
+    uint32_t count = 0; // object split: 中心落在该bin的引用数量; spatial split: 从该bin进入的引用数量
+    uint32_t exits = 0; // spatial split: 从该bin离开的引用数量
+};
+
+/**
+ * @brief (No Pointer) 一个候选划分
+ */
+class SAHSplit {
+public:
+    float cost = INFINITY;
+    int axis = -1;
+    int bin = 0; // 划分平面位于bins[bin]与bins[bin + 1]之间
+    AABB left = AABB(0, 0, 0, 0, 0, 0);
+    AABB right = AABB(0, 0, 0, 0, 0, 0);
+};
+
+/**
+ * @brief 把b合并到a. a为空时直接赋值
+ */
+static void grow(AABB *a, bool *empty, const AABB &b) {
+    *a = *empty ? b : aabb_merge(*a, b);
+    *empty = false;
+}
+
+/**
+ * @brief a与b的交集写入result
+ * @return a与b不相交时返回false
+ */
+static bool aabb_intersection(const AABB &a, const AABB &b, AABB *result) {
+    if (!aabb_collide(a, b))
+        return false;
+    for (int axis = 0; axis < 3; axis++) {
+        result->p0[axis] = max(a.p0[axis], b.p0[axis]);
+        result->p1[axis] = min(a.p1[axis], b.p1[axis]);
+    }
+    return true;
+}
+
+/**
+ * @brief 把item的face裁剪到axis上的[low, high]之间, 求裁剪后的多边形的AABB与item.aabb的交集
+ * @return 裁剪后为空时返回false
+ */
+static bool clip_reference(const BVHBuildItem &item, int axis, float low, float high, AABB *result) {
+    AABB bounds(0, 0, 0, 0, 0, 0);
+    bool empty = true;
+    const HEdge *h = item.surface->face->h;
+    do {
+        const Eigen::Vector3f &a = h->v->co;
+        const Eigen::Vector3f &b = h->next->v->co;
+        if (a[axis] >= low && a[axis] <= high)
+            grow(&bounds, &empty, AABB(a[0], a[0], a[1], a[1], a[2], a[2]));
+        // 边与两个裁剪平面的交点
+        for (float plane : {low, high}) {
+            if ((a[axis] < plane && b[axis] > plane) || (a[axis] > plane && b[axis] < plane)) {
+                Eigen::Vector3f p = a + (plane - a[axis]) / (b[axis] - a[axis]) * (b - a);
+                p[axis] = plane;
+                grow(&bounds, &empty, AABB(p[0], p[0], p[1], p[1], p[2], p[2]));
+            }
+        }
+        h = h->next;
+    } while (h != item.surface->face->h);
+    return !empty && aabb_intersection(bounds, item.aabb, result);
+}
+
+/**
+ * @brief 在所有轴上寻找代价最小的binned object split (按AABB中心分bin)
+ */
+static SAHSplit find_object_split(const SAHBuildContext *ctx, const vector<BVHBuildItem> &items) {
+    SAHSplit best;
+    int num_bins = ctx->options->num_bins;
+    Eigen::Vector3f low = items[0].aabb.p0 + items[0].aabb.p1;
+    Eigen::Vector3f high = low;
+    for (const BVHBuildItem &item : items) {
+        Eigen::Vector3f center = item.aabb.p0 + item.aabb.p1; // 中心的2倍
+        low = low.cwiseMin(center);
+        high = high.cwiseMax(center);
+    }
+    vector<SAHBin> bins(num_bins);
+    vector<float> right_area(num_bins);
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = high[axis] - low[axis];
+        if (!(extent > 0))
+            continue;
+        fill(bins.begin(), bins.end(), SAHBin());
+        for (const BVHBuildItem &item : items) {
+            int bin = (int)((item.aabb.p0[axis] + item.aabb.p1[axis] - low[axis]) / extent * num_bins);
+            bin = min(max(bin, 0), num_bins - 1);
+            grow(&bins[bin].aabb, &bins[bin].empty, item.aabb);
+            bins[bin].count++;
+        }
+        // 从右向左累计, 再从左向右扫描
+        AABB right(0, 0, 0, 0, 0, 0);
+        bool right_empty = true;
+        vector<AABB> right_bounds(num_bins, right);
+        vector<uint32_t> right_count(num_bins, 0);
+        uint32_t count = 0;
+        for (int i = num_bins - 1; i > 0; i--) {
+            if (!bins[i].empty)
+                grow(&right, &right_empty, bins[i].aabb);
+            count += bins[i].count;
+            right_bounds[i] = right;
+            right_count[i] = count;
+        }
+        AABB left(0, 0, 0, 0, 0, 0);
+        bool left_empty = true;
+        uint32_t left_count = 0;
+        for (int i = 0; i < num_bins - 1; i++) {
+            if (!bins[i].empty)
+                grow(&left, &left_empty, bins[i].aabb);
+            left_count += bins[i].count;
+            if (left_count == 0 || right_count[i + 1] == 0)
+                continue;
+            float cost = left.surface_area() * left_count + right_bounds[i + 1].surface_area() * right_count[i + 1];
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = i;
+                best.left = left;
+                best.right = right_bounds[i + 1];
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 在所有轴上寻找代价最小的spatial split (把bounds等分为bins, 图元引用被裁剪到它跨越的每个bin中)
+ */
+static SAHSplit find_spatial_split(const SAHBuildContext *ctx, const vector<BVHBuildItem> &items, const AABB &bounds) {
+    SAHSplit best;
+    int num_bins = ctx->options->num_bins;
+    vector<SAHBin> bins(num_bins);
+    for (int axis = 0; axis < 3; axis++) {
+        float low = bounds.p0[axis];
+        float extent = bounds.p1[axis] - low;
+        if (!(extent > 0))
+            continue;
+        float bin_size = extent / num_bins;
+        fill(bins.begin(), bins.end(), SAHBin());
+        for (const BVHBuildItem &item : items) {
+            int first = min(max((int)((item.aabb.p0[axis] - low) / bin_size), 0), num_bins - 1);
+            int last = min(max((int)((item.aabb.p1[axis] - low) / bin_size), first), num_bins - 1);
+            bins[first].count++;
+            bins[last].exits++;
+            for (int i = first; i <= last; i++) {
+                AABB clipped(0, 0, 0, 0, 0, 0);
+                float bin_low = i == 0 ? low : low + i * bin_size;
+                float bin_high = i == num_bins - 1 ? bounds.p1[axis] : low + (i + 1) * bin_size;
+                if (first == last) {
+                    grow(&bins[i].aabb, &bins[i].empty, item.aabb);
+                } else if (clip_reference(item, axis, bin_low, bin_high, &clipped)) {
+                    grow(&bins[i].aabb, &bins[i].empty, clipped);
+                }
+            }
+        }
+        AABB right(0, 0, 0, 0, 0, 0);
+        bool right_empty = true;
+        vector<AABB> right_bounds(num_bins, right);
+        vector<uint32_t> right_count(num_bins, 0);
+        vector<bool> right_is_empty(num_bins, true);
+        uint32_t count = 0;
+        for (int i = num_bins - 1; i > 0; i--) {
+            if (!bins[i].empty)
+                grow(&right, &right_empty, bins[i].aabb);
+            count += bins[i].exits;
+            right_bounds[i] = right;
+            right_count[i] = count;
+            right_is_empty[i] = right_empty;
+        }
+        AABB left(0, 0, 0, 0, 0, 0);
+        bool left_empty = true;
+        uint32_t left_count = 0;
+        for (int i = 0; i < num_bins - 1; i++) {
+            if (!bins[i].empty)
+                grow(&left, &left_empty, bins[i].aabb);
+            left_count += bins[i].count;
+            if (left_count == 0 || right_count[i + 1] == 0 || left_empty || right_is_empty[i + 1])
+                continue;
+            float cost = left.surface_area() * left_count + right_bounds[i + 1].surface_area() * right_count[i + 1];
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = i;
+                best.left = left;
+                best.right = right_bounds[i + 1];
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 按spatial split把items分到left和right. 跨越划分平面的引用按Stich et al. 2009的方法决定裁剪成两半或整体放入一侧
+ */
+static void partition_spatial(SAHBuildContext *ctx, const vector<BVHBuildItem> &items, const SAHSplit &split, float plane,
+                              vector<BVHBuildItem> *left, vector<BVHBuildItem> *right) {
+    int axis = split.axis;
+    AABB left_bounds = split.left;
+    AABB right_bounds = split.right;
+    uint32_t left_count = 0;
+    uint32_t right_count = 0;
+    for (const BVHBuildItem &item : items) {
+        left_count += item.aabb.p0[axis] < plane;
+        right_count += item.aabb.p1[axis] > plane;
+    }
+    for (const BVHBuildItem &item : items) {
+        if (item.aabb.p1[axis] <= plane) {
+            left->push_back(item);
+            continue;
+        }
+        if (item.aabb.p0[axis] >= plane) {
+            right->push_back(item);
+            continue;
+        }
+        AABB left_part(0, 0, 0, 0, 0, 0);
+        AABB right_part(0, 0, 0, 0, 0, 0);
+        bool has_left = clip_reference(item, axis, item.aabb.p0[axis], plane, &left_part);
+        bool has_right = clip_reference(item, axis, plane, item.aabb.p1[axis], &right_part);
+        // unsplit: 整体放入一侧的代价不高于裁剪时, 不增加引用
+        float split_cost = left_bounds.surface_area() * left_count + right_bounds.surface_area() * right_count;
+        float left_cost = aabb_merge(left_bounds, item.aabb).surface_area() * left_count + right_bounds.surface_area() * (right_count - 1);
+        float right_cost = left_bounds.surface_area() * (left_count - 1) + aabb_merge(right_bounds, item.aabb).surface_area() * right_count;
+        bool to_left = has_left && (!has_right || left_cost <= right_cost);
+        bool split = has_left && has_right && ctx->remaining_references > 0 && split_cost < min(left_cost, right_cost);
+        if (!split && to_left) {
+            left->push_back(item);
+            left_bounds = aabb_merge(left_bounds, item.aabb);
+            right_count--;
+        } else if (!split) {
+            right->push_back(item);
+            right_bounds = aabb_merge(right_bounds, item.aabb);
+            left_count--;
+        } else {
+            BVHBuildItem part = item;
+            part.aabb = left_part;
+            left->push_back(part);
+            part.aabb = right_part;
+            right->push_back(part);
+            ctx->remaining_references--;
+        }
+    }
+}
+
+/**
+ * @brief 用SAH / SBVH构建items的子树, 节点从ctx->nodes[ctx->num_nodes]开始分配
+ *
+ * @param items (Not Free) 会被清空
+ * @return 子树的根节点
+ */
+static BVHTree *build_sah_split(SAHBuildContext *ctx, vector<BVHBuildItem> *items, int depth) {
+    if (items->size() == 1 || depth >= MAX_SAH_DEPTH) {
+        BVHTree *node = build_median_split(items, 0, (int)items->size(), ctx->nodes, &ctx->num_nodes);
+        items->clear();
+        return node;
+    }
+    AABB bounds = (*items)[0].aabb;
+    for (const BVHBuildItem &item : *items) {
+        bounds = aabb_merge(bounds, item.aabb);
+    }
+    SAHSplit object_split = find_object_split(ctx, *items);
+    SAHSplit spatial_split;
+    if (ctx->options->split_method == BVHBuildOptions::SPATIAL_SPLIT && ctx->remaining_references > 0) {
+        AABB overlap(0, 0, 0, 0, 0, 0);
+        float overlap_area = 0;
+        if (object_split.axis < 0) {
+            overlap_area = bounds.surface_area(); // 所有中心重合, object split无法划分
+        } else if (aabb_intersection(object_split.left, object_split.right, &overlap)) {
+            overlap_area = overlap.surface_area();
+        }
+        if (overlap_area > ctx->options->overlap_threshold * ctx->root_area) {
+            spatial_split = find_spatial_split(ctx, *items, bounds);
+        }
+    }
+
+    vector<BVHBuildItem> left;
+    vector<BVHBuildItem> right;
+    if (spatial_split.axis >= 0 && spatial_split.cost < object_split.cost) {
+        int num_bins = ctx->options->num_bins;
+        float plane = bounds.p0[spatial_split.axis] + (bounds.p1[spatial_split.axis] - bounds.p0[spatial_split.axis]) * (spatial_split.bin + 1) / num_bins;
+        partition_spatial(ctx, *items, spatial_split, plane, &left, &right);
+    }
+    if (left.empty() || right.empty()) {
+        left.clear();
+        right.clear();
+        if (object_split.axis < 0) {
+            // 无法按SAH划分, 改用中位数划分
+            BVHTree *node = build_median_split(items, 0, (int)items->size(), ctx->nodes, &ctx->num_nodes);
+            items->clear();
+            return node;
+        }
+        int axis = object_split.axis;
+        int num_bins = ctx->options->num_bins;
+        float low = INFINITY;
+        float high = -INFINITY;
+        for (const BVHBuildItem &item : *items) {
+            low = min(low, item.aabb.p0[axis] + item.aabb.p1[axis]);
+            high = max(high, item.aabb.p0[axis] + item.aabb.p1[axis]);
+        }
+        for (const BVHBuildItem &item : *items) {
+            int bin = (int)((item.aabb.p0[axis] + item.aabb.p1[axis] - low) / (high - low) * num_bins);
+            bin = min(max(bin, 0), num_bins - 1);
+            (bin <= object_split.bin ? left : right).push_back(item);
+        }
+    }
+    vector<BVHBuildItem>().swap(*items); // 释放内存
+
+    BVHTree *node = ctx->nodes + ctx->num_nodes++;
+    node->aabb = bounds;
+    node->left = build_sah_split(ctx, &left, depth + 1);
+    node->right = build_sah_split(ctx, &right, depth + 1);
+    return node;
+}
+
+int build_model_bvh(Model *model, bool recursive) {
+    BVHBuildOptions options;
+    return build_model_bvh_with_options(model, &options, recursive);
+}
+
+int build_model_bvh_with_options(Model *model, const BVHBuildOptions *options, bool recursive) {
+    if (model == nullptr || options == nullptr) {
+        return 1;
+    }
+    if (options->split_method < BVHBuildOptions::MEDIAN_SPLIT || options->split_method > BVHBuildOptions::SPATIAL_SPLIT ||
+        options->num_bins < 2 || !(options->max_reference_growth >= 0) || !(options->overlap_threshold >= 0)) {
+        return 2;
+    }
+    free_model_bvh(model, false);
+    ModelBVH *bvh = new ModelBVH();
+    if (model->num_faces > 0) {
+        bvh->num_surfaces = model->num_faces;
+        bvh->surfaces = new FaceSurface[model->num_faces];
+        vector<BVHBuildItem> items(model->num_faces);
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            bvh->surfaces[i].face = model->faces + i;
+            items[i].aabb = bvh->surfaces[i].aabb();
+            items[i].surface = bvh->surfaces + i;
+        }
+        if (options->split_method == BVHBuildOptions::MEDIAN_SPLIT) {
+            bvh->nodes = new BVHTree[2 * model->num_faces - 1];
+            bvh->root = build_median_split(&items, 0, (int)items.size(), bvh->nodes, &bvh->num_nodes);
+        } else {
+            SAHBuildContext ctx;
+            ctx.options = options;
+            if (options->split_method == BVHBuildOptions::SPATIAL_SPLIT)
+                ctx.remaining_references = (int64_t)(options->max_reference_growth * model->num_faces);
+            AABB bounds = items[0].aabb;
+            for (const BVHBuildItem &item : items) {
+                bounds = aabb_merge(bounds, item.aabb);
+            }
+            ctx.root_area = bounds.surface_area();
+            uint32_t capacity = 2 * (model->num_faces + (uint32_t)ctx.remaining_references) - 1;
+            ctx.nodes = new BVHTree[capacity];
+            build_sah_split(&ctx, &items, 0);
+            bvh->nodes = ctx.nodes;
+            bvh->num_nodes = ctx.num_nodes;
+            if (ctx.num_nodes < capacity) {
+                // 未用完spatial split的预算, 把节点复制到大小恰好的数组中
+                bvh->nodes = new BVHTree[ctx.num_nodes];
+                for (uint32_t i = 0; i < ctx.num_nodes; i++) {
+                    bvh->nodes[i] = ctx.nodes[i];
+                    if (ctx.nodes[i].left != nullptr)
+                        bvh->nodes[i].left = bvh->nodes + (ctx.nodes[i].left - ctx.nodes);
+                    if (ctx.nodes[i].right != nullptr)
+                        bvh->nodes[i].right = bvh->nodes + (ctx.nodes[i].right - ctx.nodes);
+                }
+                delete[] ctx.nodes;
+            }
+            bvh->root = bvh->nodes;
+        }
+    }
+    model->bvh = bvh;
+    if (recursive) {
+        ModelList *model_list = model->submodels;
+        int submodel_index = 0;
+        while (model_list != nullptr) {
+            int ret = build_model_bvh_with_options(model_list->model, options, recursive);
+            if (ret != 0) {
+                return 100 + submodel_index;
+            }
+            submodel_index++;
+            model_list = model_list->next;
+        }
+    }
+    return 0;
+}
+
+float bvh_sah_cost(const BVHTree *tree, float traversal_cost, float intersection_cost) {
+    if (tree == nullptr || !(tree->aabb.surface_area() > 0))
+        return 0;
+    double cost = 0;
+    const BVHTree *stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = tree;
+    while (stack_size > 0) {
+        const BVHTree *node = stack[--stack_size];
+        cost += node->aabb.surface_area() * (node->surface != nullptr ? intersection_cost : traversal_cost);
+        if (node->left != nullptr)
+            stack[stack_size++] = node->left;
+        if (node->right != nullptr)
+            stack[stack_size++] = node->right;
+    }
+    return (float)(cost / tree->aabb.surface_area());
+}
+
+int free_model_bvh(Model *model, bool recursive) {
+    if (model == nullptr) {
+        return 1;
+    }
+    if (model->bvh != nullptr) {
+        delete[] model->bvh->nodes;
+        delete[] model->bvh->surfaces;
+        delete model->bvh;
+        model->bvh = nullptr;
+    }
+    if (recursive) {
+        for (ModelList *model_list = model->submodels; model_list != nullptr; model_list = model_list->next) {
+            free_model_bvh(model_list->model, recursive);
+        }
+    }
+    return 0;
+}
+
+bool bvh_ray_hit(const BVHTree *tree, const Ray &ray, float t0, float t1, HitRecord *hit_record) {
+    return bvh_ray_hit(tree, PrecomputedRay(ray), t0, t1, hit_record);
+}
+
+bool bvh_ray_hit(const BVHTree *tree, const PrecomputedRay &ray, float t0, float t1, HitRecord *hit_record) {
+    if (hit_record != nullptr)
+        hit_record->hit = false;
+    if (tree == nullptr)
+        return false;
+    bool hit = false;
+    const BVHTree *stack[64]; // 树深度小于64, 见build_model_bvh_with_options
+    int stack_size = 0;
+    stack[stack_size++] = tree;
+    HitRecord record(false, 0);
+    while (stack_size > 0) {
+        const BVHTree *node = stack[--stack_size];
+        if (!aabb_ray_slab(ray, node->aabb, t0, t1, nullptr))
+            continue;
+        if (node->surface != nullptr) {
+            if (node->surface->ray_hit_precomputed(ray, t0, t1, &record)) {
+                hit = true;
+                t1 = record.t; // 之后只接受更近的交点
+                if (hit_record != nullptr)
+                    *hit_record = record;
+            }
+            continue;
+        }
+        if (node->left != nullptr)
+            stack[stack_size++] = node->left;
+        if (node->right != nullptr)
+            stack[stack_size++] = node->right;
+    }
+    return hit;
+}
+
+void bvh_frustum_cull(const BVHTree *tree, const Frustum &frustum, uint32_t max_candidates, vector<const BVHTree *> *candidates) {
+    if (tree == nullptr)
+        return;
+    int relation = frustum_aabb_test(frustum, tree->aabb);
+    if (relation == 0)
+        return;
+    // 按层展开与frustum相交的节点, 使上层的裁剪先完成. queue中是尚未决定是否展开的节点及其与frustum的关系
+    deque<pair<const BVHTree *, int>> queue;
+    queue.emplace_back(tree, relation);
+    size_t num_output = 0; // 已追加到candidates的数量
+    while (!queue.empty()) {
+        const BVHTree *node = queue.front().first;
+        relation = queue.front().second;
+        queue.pop_front();
+        if (relation == 2 || node->surface != nullptr) {
+            candidates->push_back(node);
+            num_output++;
+            continue;
+        }
+        const BVHTree *children[2] = {node->left, node->right};
+        int relations[2] = {0, 0};
+        size_t num_survivors = 0;
+        for (int i = 0; i < 2; i++) {
+            if (children[i] != nullptr) {
+                relations[i] = frustum_aabb_test(frustum, children[i]->aabb);
+                num_survivors += relations[i] != 0;
+            }
+        }
+        if (num_output + queue.size() + num_survivors > max_candidates) {
+            candidates->push_back(node); // 展开后候选子树过多, 保留该节点
+            num_output++;
+            continue;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (relations[i] != 0)
+                queue.emplace_back(children[i], relations[i]);
+        }
+    }
+}
@@ -17,8 +17,27 @@ AABB aabb_merge(const AABB &a, const AABB &b) {
 
 bool aabb_collide(const AABB &a, const AABB &b) {
     return !(
-        (a.p1[0] < b.p0[0] || b.p1[0] < a.p0[0]) && 
-        (a.p1[1] < b.p0[1] || b.p1[1] < a.p0[1]) && 
+        (a.p1[0] < b.p0[0] || b.p1[0] < a.p0[0]) || 
+        (a.p1[1] < b.p0[1] || b.p1[1] < a.p0[1]) || 
         (a.p1[2] < b.p0[2] || b.p1[2] < a.p0[2])
     );
 }
+
+
+int frustum_aabb_test(const Frustum &frustum, const AABB &aabb) {
+    int ret = 2;
+    for (int i = 0; i < frustum.num_planes; i++) {
+        const Eigen::Vector3f &n = frustum.normals[i];
+        // 在法线方向上最远和最近的顶点
+        Eigen::Vector3f far_corner, near_corner;
+        for (int axis = 0; axis < 3; axis++) {
+            far_corner[axis] = n[axis] >= 0 ? aabb.p1[axis] : aabb.p0[axis];
+            near_corner[axis] = n[axis] >= 0 ? aabb.p0[axis] : aabb.p1[axis];
+        }
+        if (n.dot(far_corner) + frustum.offsets[i] < 0)
+            return 0;
+        if (n.dot(near_corner) + frustum.offsets[i] < 0)
+            ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,417 @@
+/**
+ * @file daemon.cpp
+ * @brief daemon.h的具体实现
+ */
+#include <daemon.h>
+
+#ifdef _WIN32
+
+int run_render_daemon(const char *socket_path, int num_threads, uint64_t cache_budget) { return 3; }
+
+#else
+
+#include <atomic>
+#include <bvh.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <footprint.h>
+#include <list>
+#include <mutex>
+#include <netio.h>
+#include <pipeline.h>
+#include <ppm.h>
+#include <render.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+static const int TILE_SIZE = 32;               // 调度的最小单位是TILE_SIZE x TILE_SIZE个像素
+static const int MAX_IMAGE_SIZE = 16384;       // width和height的上限
+static const size_t MAX_REQUEST_LENGTH = 4096; // 一行请求的最大长度
+static const int MAX_CONNECTIONS = 64;         // 同时处理的连接数量上限, 每个连接占用一个线程
+static const int REQUEST_TIMEOUT = 10;         // 接收请求行的时限(秒)
+
+/**
+ * @brief (Has Pointer) 缓存中的一个场景
+ */
+class CachedScene {
+public:
+    int64_t mtime = 0;      // obj文件的修改时间(纳秒)
+    Model *model = nullptr; // 由parse_obj_file_pipelined加载的场景
+    uint64_t bytes = 0;     // model_footprint的统计
+    uint64_t last_used = 0; // 最近一次被请求时的DaemonState::clock
+    int refs = 0;           // 正在使用该场景的请求数量
+    bool stale = false;     // 已被更新的版本替换, refs降为0时释放
+};
+
+/**
+ * @brief (Has Pointer) 一个渲染请求
+ */
+class RenderJob {
+public:
+    const Model *model = nullptr;
+    Camera camera;
+    int width = 0;
+    int height = 0;
+    int spp = 0;         // samples per pixel
+    int num_tiles_x = 0; // number of tiles along x
+    int num_tiles = 0;   // number of tiles
+    int next_tile = 0;   // 下一个待渲染的tile
+    int done_tiles = 0;  // 已完成的tiles
+    int status = 0;      // 第一个失败的render_tile_to_framebuffer状态码
+    Framebuffer framebuffer; // 各渲染线程按tile写入, 32 x 32的tile与Framebuffer::TILE_SIZE对齐
+    condition_variable done_cv;
+};
+
+/**
+ * @brief (Has Pointer) 服务的全部状态
+ */
+class DaemonState {
+public:
+    int listen_fd = -1;
+    atomic<bool> stop{false};
+
+    mutex scene_lock; // 保护以下成员, 以及CachedScene::last_used, refs, stale
+    unordered_map<string, CachedScene *> scenes;
+    uint64_t cache_budget = 0; // 见run_render_daemon
+    uint64_t cached_bytes = 0; // 所有尚未释放的场景(包括stale)的bytes之和
+    uint64_t clock = 0;        // LRU时钟
+
+    mutex job_lock; // 保护jobs, stop_workers以及RenderJob中的调度字段
+    condition_variable job_cv;
+    list<RenderJob *> jobs; // 仍有未分配tile的请求, 按轮转顺序排列
+    bool stop_workers = false;
+    vector<thread> workers;
+
+    mutex conn_lock; // 保护num_connections
+    condition_variable conn_cv;
+    int num_connections = 0; // 正在处理的连接数量
+};
+
+/**
+ * @brief 文件的修改时间(纳秒). 文件不存在时返回-1
+ */
+static int64_t file_mtime(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+#ifdef __APPLE__
+    return (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * @param scene (Definite Free)
+ */
+static void destroy_scene(CachedScene *scene) {
+    free_model_bvh(scene->model, true);
+    free_model_tree(scene->model);
+    delete scene->model;
+    delete scene;
+}
+
+/**
+ * @brief 释放一个已经不在scenes中的场景, 并从cached_bytes中减去它. 调用时需持有scene_lock
+ * @param scene (Definite Free)
+ */
+static void drop_scene(DaemonState *state, CachedScene *scene) {
+    state->cached_bytes -= scene->bytes;
+    destroy_scene(scene);
+}
+
+/**
+ * @brief cached_bytes超过cache_budget时, 按最久未使用的顺序释放没有请求使用的场景. 调用时需持有scene_lock
+ */
+static void evict_scenes(DaemonState *state) {
+    while (state->cached_bytes > state->cache_budget) {
+        auto victim = state->scenes.end();
+        for (auto p = state->scenes.begin(); p != state->scenes.end(); p++) {
+            if (p->second->refs == 0 && (victim == state->scenes.end() || p->second->last_used < victim->second->last_used)) {
+                victim = p;
+            }
+        }
+        if (victim == state->scenes.end()) {
+            return; // 剩下的场景都在使用中
+        }
+        CachedScene *scene = victim->second;
+        state->scenes.erase(victim);
+        drop_scene(state, scene);
+    }
+}
+
+/**
+ * @brief 从缓存获取path对应的最新场景, 必要时加载. 成功后需调用release_scene.
+ * @param state (Not Free)
+ * @param scene (Not Free) 输出 (External Ret)
+ * @return 0表示成功, 否则表示加载失败
+ */
+static int acquire_scene(DaemonState *state, const string &path, CachedScene **scene) {
+    int64_t mtime = file_mtime(path.c_str());
+    if (mtime < 0) {
+        return 1;
+    }
+    {
+        lock_guard<mutex> guard(state->scene_lock);
+        auto p = state->scenes.find(path);
+        if (p != state->scenes.end() && p->second->mtime == mtime) {
+            p->second->refs++;
+            p->second->last_used = ++state->clock;
+            *scene = p->second;
+            return 0;
+        }
+    }
+    // 加载时不持有锁, 其它场景的请求不受影响. 同一场景可能被并发加载多次, 只有一份会留在缓存中.
+    CachedScene *loaded = new CachedScene();
+    loaded->mtime = mtime;
+    loaded->model = new Model();
+    if (parse_obj_file_pipelined(path.c_str(), loaded->model, 0, false) != 0) {
+        destroy_scene(loaded);
+        return 2;
+    }
+    MemoryFootprint footprint;
+    model_footprint(loaded->model, true, &footprint, nullptr);
+    loaded->bytes = footprint.total();
+    lock_guard<mutex> guard(state->scene_lock);
+    auto p = state->scenes.find(path);
+    if (p != state->scenes.end()) {
+        if (p->second->mtime == mtime) {
+            destroy_scene(loaded);
+            p->second->refs++;
+            p->second->last_used = ++state->clock;
+            *scene = p->second;
+            return 0;
+        }
+        p->second->stale = true;
+        if (p->second->refs == 0) {
+            drop_scene(state, p->second);
+        }
+    }
+    loaded->refs = 1;
+    loaded->last_used = ++state->clock;
+    state->scenes[path] = loaded;
+    state->cached_bytes += loaded->bytes;
+    evict_scenes(state);
+    *scene = loaded;
+    return 0;
+}
+
+/**
+ * @param scene (Sub Free) 如果已过期且不再被使用, 或者缓存超出预算, 会被释放
+ */
+static void release_scene(DaemonState *state, CachedScene *scene) {
+    lock_guard<mutex> guard(state->scene_lock);
+    scene->refs--;
+    if (scene->stale && scene->refs == 0) {
+        drop_scene(state, scene);
+    } else {
+        evict_scenes(state);
+    }
+}
+
+/**
+ * @brief 渲染线程: 每次从jobs头部的请求取一个tile, 然后把该请求移到队尾
+ */
+static void render_worker(DaemonState *state) {
+    SobolSampler sampler(0);
+    unique_lock<mutex> guard(state->job_lock);
+    while (true) {
+        state->job_cv.wait(guard, [state] { return state->stop_workers || !state->jobs.empty(); });
+        if (state->jobs.empty()) {
+            return;
+        }
+        RenderJob *job = state->jobs.front();
+        state->jobs.pop_front();
+        int tile_index = job->next_tile++;
+        if (job->next_tile < job->num_tiles) {
+            state->jobs.push_back(job);
+        }
+        guard.unlock();
+
+        int x0 = tile_index % job->num_tiles_x * TILE_SIZE;
+        int y0 = tile_index / job->num_tiles_x * TILE_SIZE;
+        int x1 = min(x0 + TILE_SIZE, job->width);
+        int y1 = min(y0 + TILE_SIZE, job->height);
+        int ret = render_tile_to_framebuffer(job->model, &job->camera, &sampler, job->spp, x0, y0, x1, y1, &job->framebuffer);
+
+        guard.lock();
+        if (ret != 0 && job->status == 0) {
+            job->status = ret;
+        }
+        job->done_tiles++;
+        if (job->done_tiles == job->num_tiles) {
+            job->done_cv.notify_all();
+        }
+    }
+}
+
+/**
+ * @brief 把job交给渲染线程, 等待所有tiles完成
+ * @param job (Not Free)
+ */
+static void run_job(DaemonState *state, RenderJob *job) {
+    job->num_tiles_x = (job->width + TILE_SIZE - 1) / TILE_SIZE;
+    job->num_tiles = job->num_tiles_x * ((job->height + TILE_SIZE - 1) / TILE_SIZE);
+    unique_lock<mutex> guard(state->job_lock);
+    state->jobs.push_back(job);
+    state->job_cv.notify_all();
+    job->done_cv.wait(guard, [job] { return job->done_tiles == job->num_tiles; });
+}
+
+/**
+ * @brief 向fd写入"ERR <code>\n"
+ */
+static void send_error(int fd, int code) {
+    char message[32];
+    int len = snprintf(message, sizeof(message), "ERR %d\n", code);
+    send_all(fd, message, len);
+}
+
+/**
+ * @brief 对端进程是否与服务进程属于同一用户, 或者是root. 无法获得对端用户时返回false
+ */
+static bool peer_is_owner(int fd) {
+#ifdef __linux__
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        return false;
+    }
+    uid_t uid = cred.uid;
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+    if (getpeereid(fd, &uid, &gid) != 0) {
+        return false;
+    }
+#endif
+    return uid == geteuid() || uid == 0;
+}
+
+/**
+ * @brief 处理一个连接, 结束时关闭fd
+ */
+static void handle_connection(DaemonState *state, int fd) {
+    string line;
+    char path[1024];
+    RenderJob job;
+    Eigen::Vector3f &eye = job.camera.eye;
+    Eigen::Vector3f &target = job.camera.target;
+    Eigen::Vector3f &up = job.camera.up;
+    if (!recv_line_before(fd, &line, MAX_REQUEST_LENGTH, chrono::steady_clock::now() + chrono::seconds(REQUEST_TIMEOUT))) {
+        send_error(fd, 1);
+    } else if (line == "SHUTDOWN" && !peer_is_owner(fd)) {
+        send_error(fd, 5);
+    } else if (line == "SHUTDOWN") {
+        state->stop = true;
+        shutdown(state->listen_fd, SHUT_RDWR); // 唤醒accept
+    } else if (sscanf(line.c_str(), "RENDER %1023s %d %d %d %f %f %f %f %f %f %f %f %f %f", path, &job.width, &job.height, &job.spp,
+                      &eye[0], &eye[1], &eye[2], &target[0], &target[1], &target[2], &up[0], &up[1], &up[2], &job.camera.fov) != 14) {
+        send_error(fd, 1);
+    } else if (job.width <= 0 || job.height <= 0 || job.spp <= 0 || job.width > MAX_IMAGE_SIZE || job.height > MAX_IMAGE_SIZE) {
+        send_error(fd, 2);
+    } else {
+        CachedScene *scene = nullptr;
+        if (acquire_scene(state, path, &scene) != 0) {
+            send_error(fd, 3);
+        } else {
+            job.model = scene->model;
+            init_framebuffer(&job.framebuffer, job.width, job.height);
+            run_job(state, &job);
+            release_scene(state, scene);
+            if (job.status != 0) {
+                send_error(fd, 4);
+            } else {
+                uint8_t *image = new uint8_t[(size_t)job.width * job.height * 3];
+                resolve_framebuffer(&job.framebuffer, 0, image);
+                FILE *out = fdopen(dup(fd), "wb");
+                if (out != nullptr) {
+                    write_ppm(out, image, job.width, job.height);
+                    fclose(out);
+                }
+                delete[] image;
+            }
+            free_framebuffer(&job.framebuffer);
+        }
+    }
+    close(fd);
+    lock_guard<mutex> guard(state->conn_lock);
+    state->num_connections--;
+    state->conn_cv.notify_all();
+}
+
+int run_render_daemon(const char *socket_path, int num_threads, uint64_t cache_budget) {
+    if (socket_path == nullptr) {
+        return 1;
+    }
+    string address = string("unix:") + socket_path;
+    signal(SIGPIPE, SIG_IGN); // 客户端提前断开时不终止服务
+
+    DaemonState state;
+    state.cache_budget = cache_budget;
+    int ret = listen_address(address.c_str(), &state.listen_fd);
+    if (ret == 2) {
+        return 1;
+    } else if (ret != 0) {
+        return 2;
+    }
+    if (num_threads < 1) {
+        num_threads = max(1, (int)thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_threads; i++) {
+        state.workers.emplace_back(render_worker, &state);
+    }
+
+    while (!state.stop) {
+        {
+            // 达到上限时暂停accept, 新连接在listen队列中等待
+            unique_lock<mutex> guard(state.conn_lock);
+            state.conn_cv.wait(guard, [&state] { return state.num_connections < MAX_CONNECTIONS; });
+        }
+        int fd = accept(state.listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        {
+            lock_guard<mutex> guard(state.conn_lock);
+            state.num_connections++;
+        }
+        thread(handle_connection, &state, fd).detach();
+    }
+
+    {
+        unique_lock<mutex> guard(state.conn_lock);
+        state.conn_cv.wait(guard, [&state] { return state.num_connections == 0; });
+    }
+    {
+        lock_guard<mutex> guard(state.job_lock);
+        state.stop_workers = true;
+        state.job_cv.notify_all();
+    }
+    for (auto &worker : state.workers) {
+        worker.join();
+    }
+    for (auto &p : state.scenes) {
+        destroy_scene(p.second);
+    }
+    close(state.listen_fd);
+    unlink_address(address.c_str());
+    return 0;
+}
+
+#endif // _WIN32
@@ -0,0 +1,384 @@
+/**
+ * @file distributed.cpp
+ * @brief distributed.h的具体实现
+ * @details 协议(每条消息一行, 以'\n'结尾): \n
+ *  coordinator -> worker: "SCENE <obj> <width> <height> <spp> <eye xyz> <target xyz> <up xyz> <fov>", "TILE <i> <x0> <y0> <x1> <y1>", "DONE" \n
+ *  worker -> coordinator: "NEXT", "RESULT <i> <nbytes>"之后紧跟nbytes字节的RGB数据, "FAIL <code>" \n
+ *  worker加载场景后发送NEXT; 之后每个RESULT同时表示领取下一个tile.
+ */
+#include <distributed.h>
+
+#ifdef _WIN32
+
+int run_coordinator(const char *address, const char *obj_path, const Camera *camera, int width, int height, int spp, int tile_size,
+                    int num_local_workers, int tile_timeout, const char *ppm_path) {
+    return 5;
+}
+
+int run_worker(const char *address) { return 6; }
+
+#else
+
+#include <bvh.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <netio.h>
+#include <pipeline.h>
+#include <ppm.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+static const size_t MAX_MESSAGE_LENGTH = 4096; // 一行消息的最大长度
+static const int MAX_TILE_FAILURES = 3;        // 同一个tile被报告FAIL的次数达到该值时放弃渲染
+
+/**
+ * @brief (Has Pointer) coordinator的全部状态
+ */
+class CoordinatorState {
+public:
+    string scene_message; // 发送给每个worker的SCENE消息
+    int width = 0;
+    int height = 0;
+    int tile_size = 0;
+    int tile_timeout = 0; // 每个tile的超时(秒), 0表示不超时
+    int num_tiles_x = 0; // number of tiles along x
+    int num_tiles = 0;   // number of tiles
+    uint8_t *image = nullptr;
+
+    mutex lock; // 保护以下所有成员
+    condition_variable cv;
+    deque<int> pending;    // 待分配的tiles
+    vector<bool> finished; // 每个tile是否已完成
+    vector<int> failures;  // 每个tile被worker报告FAIL的次数
+    int num_done = 0;      // 已完成的tiles数量
+    int failed_tile = -1;  // 失败次数达到MAX_TILE_FAILURES的tile, -1表示没有
+    int failure_code = 0;  // failed_tile最后一次FAIL的状态码
+    int num_connections = 0;
+    vector<int> fds; // 所有仍在处理的worker连接
+};
+
+/**
+ * @brief 把tile的像素范围写入x0, y0, x1, y1
+ */
+static void tile_bounds(const CoordinatorState *state, int tile, int *x0, int *y0, int *x1, int *y1) {
+    *x0 = tile % state->num_tiles_x * state->tile_size;
+    *y0 = tile / state->num_tiles_x * state->tile_size;
+    *x1 = min(*x0 + state->tile_size, state->width);
+    *y1 = min(*y0 + state->tile_size, state->height);
+}
+
+/**
+ * @brief 处理一个worker连接, 直到画面完成, 连接断开或tile超时. 结束时把未完成的tile放回pending.
+ * @details 加载场景的时间不受限制; 领取tile后必须在tile_timeout秒内发回完整的RESULT(包括数据), 否则被视为卡死, 不再给它分配tiles
+ */
+static void serve_worker(CoordinatorState *state, int fd) {
+    int outstanding = -1;                      // 已分配给该worker但尚未完成的tile
+    chrono::steady_clock::time_point deadline; // outstanding的截止时间
+    vector<uint8_t> tile_data;
+    bool ok = send_all(fd, state->scene_message.c_str(), state->scene_message.size());
+    while (ok) {
+        bool timed = outstanding >= 0 && state->tile_timeout > 0;
+        string line;
+        if (!(timed ? recv_line_before(fd, &line, MAX_MESSAGE_LENGTH, deadline) : recv_line(fd, &line, MAX_MESSAGE_LENGTH))) {
+            break;
+        }
+        int tile = 0, code = 0;
+        size_t num_bytes = 0;
+        if (outstanding >= 0 && sscanf(line.c_str(), "FAIL %d", &code) == 1) {
+            // worker发送FAIL后会退出, tile在下面重新分配; 同一个tile反复失败时放弃渲染, 避免无限重试
+            lock_guard<mutex> guard(state->lock);
+            if (++state->failures[outstanding] >= MAX_TILE_FAILURES && state->failed_tile < 0) {
+                state->failed_tile = outstanding;
+                state->failure_code = code;
+                state->cv.notify_all();
+            }
+            break;
+        } else if (sscanf(line.c_str(), "RESULT %d %zu", &tile, &num_bytes) == 2) {
+            int x0, y0, x1, y1;
+            if (tile != outstanding) {
+                break;
+            }
+            tile_bounds(state, tile, &x0, &y0, &x1, &y1);
+            if (num_bytes != (size_t)(x1 - x0) * (y1 - y0) * 3) {
+                break;
+            }
+            tile_data.resize(num_bytes);
+            if (!(timed ? recv_all_before(fd, tile_data.data(), num_bytes, deadline) : recv_all(fd, tile_data.data(), num_bytes))) {
+                break;
+            }
+            lock_guard<mutex> guard(state->lock);
+            for (int y = y0; y < y1; y++) {
+                memcpy(state->image + ((size_t)y * state->width + x0) * 3, tile_data.data() + (size_t)(y - y0) * (x1 - x0) * 3,
+                       (x1 - x0) * 3);
+            }
+            state->finished[tile] = true;
+            state->num_done++;
+            outstanding = -1;
+            state->cv.notify_all();
+        } else if (line != "NEXT") {
+            break; // 无法识别的消息
+        }
+
+        // 等待可分配的tile. pending为空但画面未完成时, 其它worker可能断开, 它们的tiles会被放回pending
+        unique_lock<mutex> guard(state->lock);
+        state->cv.wait(guard, [state] { return !state->pending.empty() || state->num_done == state->num_tiles; });
+        if (state->num_done == state->num_tiles) {
+            guard.unlock();
+            send_all(fd, "DONE\n", 5);
+            break;
+        }
+        outstanding = state->pending.front();
+        state->pending.pop_front();
+        guard.unlock();
+        deadline = chrono::steady_clock::now() + chrono::seconds(state->tile_timeout);
+        int x0, y0, x1, y1;
+        tile_bounds(state, outstanding, &x0, &y0, &x1, &y1);
+        char message[128];
+        int len = snprintf(message, sizeof(message), "TILE %d %d %d %d %d\n", outstanding, x0, y0, x1, y1);
+        ok = send_all(fd, message, len);
+    }
+    lock_guard<mutex> guard(state->lock);
+    if (outstanding >= 0 && !state->finished[outstanding]) {
+        state->pending.push_front(outstanding); // 重新分配
+    }
+    for (size_t i = 0; i < state->fds.size(); i++) {
+        if (state->fds[i] == fd) {
+            state->fds.erase(state->fds.begin() + i);
+            break;
+        }
+    }
+    close(fd);
+    state->num_connections--;
+    state->cv.notify_all();
+}
+
+int run_coordinator(const char *address, const char *obj_path, const Camera *camera, int width, int height, int spp, int tile_size,
+                    int num_local_workers, int tile_timeout, const char *ppm_path) {
+    if (address == nullptr || obj_path == nullptr || camera == nullptr || ppm_path == nullptr || width <= 0 || height <= 0 ||
+        spp <= 0 || tile_size <= 0) {
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // worker断开时不终止coordinator
+    int listen_fd = -1;
+    if (listen_address(address, &listen_fd) != 0) {
+        return 2;
+    }
+
+    CoordinatorState state;
+    char message[2048];
+    const Camera &c = *camera;
+    snprintf(message, sizeof(message), "SCENE %s %d %d %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", obj_path, width, height,
+             spp, c.eye[0], c.eye[1], c.eye[2], c.target[0], c.target[1], c.target[2], c.up[0], c.up[1], c.up[2], c.fov);
+    state.scene_message = message;
+    state.width = width;
+    state.height = height;
+    state.tile_size = tile_size;
+    state.tile_timeout = max(tile_timeout, 0);
+    state.num_tiles_x = (width + tile_size - 1) / tile_size;
+    state.num_tiles = state.num_tiles_x * ((height + tile_size - 1) / tile_size);
+    state.finished.resize(state.num_tiles, false);
+    state.failures.resize(state.num_tiles, 0);
+    for (int i = 0; i < state.num_tiles; i++) {
+        state.pending.push_back(i);
+    }
+    state.image = new uint8_t[(size_t)width * height * 3];
+    memset(state.image, 0, (size_t)width * height * 3);
+
+    // fork必须在创建任何线程之前
+    vector<pid_t> children;
+    for (int i = 0; i < num_local_workers; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            _exit(run_worker(address));
+        } else if (pid > 0) {
+            children.push_back(pid);
+        }
+    }
+
+    vector<thread> handlers;
+    mutex handlers_lock; // 保护handlers
+    thread acceptor([&] {
+        while (true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return; // listen_fd已被shutdown
+            }
+            enable_keepalive(fd);
+            {
+                lock_guard<mutex> guard(state.lock);
+                state.num_connections++;
+                state.fds.push_back(fd);
+            }
+            lock_guard<mutex> guard(handlers_lock);
+            handlers.emplace_back(serve_worker, &state, fd);
+        }
+    });
+
+    int ret = 0;
+    {
+        unique_lock<mutex> guard(state.lock);
+        size_t num_exited = 0; // number of exited local workers
+        while (state.num_done < state.num_tiles) {
+            state.cv.wait_for(guard, chrono::milliseconds(100));
+            if (state.failed_tile >= 0) {
+                ret = 100 + state.failure_code;
+                break;
+            }
+            while (num_exited < children.size() && waitpid(-1, nullptr, WNOHANG) > 0) {
+                num_exited++;
+            }
+            if (!children.empty() && num_exited == children.size() && state.num_connections == 0 && state.num_done < state.num_tiles) {
+                ret = 3;
+                break;
+            }
+        }
+        // 唤醒仍在等待worker消息的连接, 它们的worker会在连接关闭后退出
+        for (int fd : state.fds) {
+            shutdown(fd, SHUT_RD);
+        }
+        state.cv.notify_all();
+    }
+    shutdown(listen_fd, SHUT_RDWR);
+    acceptor.join();
+    close(listen_fd);
+    unlink_address(address);
+    for (auto &handler : handlers) {
+        handler.join();
+    }
+    // 因超时被断开的本地worker可能仍然卡住
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(state.tile_timeout);
+    for (pid_t pid : children) {
+        if (state.tile_timeout > 0) {
+            pid_t exited = 0;
+            while ((exited = waitpid(pid, nullptr, WNOHANG)) == 0 && chrono::steady_clock::now() < deadline) {
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+            if (exited != 0) {
+                continue; // 已退出(或已在上面的循环中回收)
+            }
+            kill(pid, SIGKILL);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+
+    if (ret == 0) {
+        FILE *out = fopen(ppm_path, "wb");
+        if (out == nullptr) {
+            ret = 4;
+        } else {
+            write_ppm(out, state.image, width, height);
+            fclose(out);
+        }
+    }
+    delete[] state.image;
+    return ret;
+}
+
+/**
+ * @brief 向coordinator发送"FAIL <code>\n"
+ */
+static void send_fail(int fd, int code) {
+    char message[32];
+    int len = snprintf(message, sizeof(message), "FAIL %d\n", code);
+    send_all(fd, message, len);
+}
+
+int run_worker(const char *address) {
+    if (address == nullptr) {
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int fd = -1;
+    for (int attempt = 0; connect_address(address, &fd) != 0; attempt++) {
+        if (attempt >= 100) {
+            return 2;
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+
+    string line;
+    char path[1024];
+    int width = 0, height = 0, spp = 0;
+    Camera camera;
+    Eigen::Vector3f &eye = camera.eye;
+    Eigen::Vector3f &target = camera.target;
+    Eigen::Vector3f &up = camera.up;
+    if (!recv_line(fd, &line, MAX_MESSAGE_LENGTH)) {
+        close(fd);
+        return 5;
+    }
+    if (sscanf(line.c_str(), "SCENE %1023s %d %d %d %f %f %f %f %f %f %f %f %f %f", path, &width, &height, &spp, &eye[0], &eye[1],
+               &eye[2], &target[0], &target[1], &target[2], &up[0], &up[1], &up[2], &camera.fov) != 14 ||
+        width <= 0 || height <= 0 || spp <= 0) {
+        close(fd);
+        return 3;
+    }
+    Model model = Model();
+    int error_code = parse_obj_file_pipelined(path, &model, 0, false);
+    if (error_code != 0) {
+        send_fail(fd, error_code);
+        close(fd);
+        return 4;
+    }
+
+    int ret = 5;
+    SobolSampler sampler(0);
+    vector<uint8_t> tile_data;
+    if (send_all(fd, "NEXT\n", 5)) {
+        while (true) {
+            line.clear();
+            if (!recv_line(fd, &line, MAX_MESSAGE_LENGTH)) {
+                break;
+            }
+            if (line == "DONE") {
+                ret = 0;
+                break;
+            }
+            int tile, x0, y0, x1, y1;
+            if (sscanf(line.c_str(), "TILE %d %d %d %d %d", &tile, &x0, &y0, &x1, &y1) != 5) {
+                ret = 3;
+                break;
+            }
+            // 先检查范围再分配tile_data, 否则x1 < x0时大小会溢出
+            if (x0 < 0 || y0 < 0 || x1 > width || y1 > height || x0 >= x1 || y0 >= y1) {
+                send_fail(fd, 5); // 同render_tile的[5]
+                ret = 3;
+                break;
+            }
+            tile_data.resize((size_t)(x1 - x0) * (y1 - y0) * 3);
+            int render_ret = render_tile(&model, &camera, &sampler, width, height, spp, x0, y0, x1, y1, tile_data.data());
+            if (render_ret != 0) {
+                send_fail(fd, render_ret);
+                ret = 3;
+                break;
+            }
+            char message[64];
+            int len = snprintf(message, sizeof(message), "RESULT %d %zu\n", tile, tile_data.size());
+            if (!send_all(fd, message, len) || !send_all(fd, tile_data.data(), tile_data.size())) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    free_model_bvh(&model, true);
+    free_model_tree(&model);
+    return ret;
+}
+
+#endif // _WIN32
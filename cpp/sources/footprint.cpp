@@ -0,0 +1,284 @@
+/**
+ * @file footprint.cpp
+ * @brief footprint.h的具体实现
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <footprint.h>
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+uint64_t allocation_overhead(uint64_t size) {
+    uint64_t chunk = max<uint64_t>(32, (size + 8 + 15) / 16 * 16);
+    return chunk - size;
+}
+
+/**
+ * @brief 估计unordered_map在num_entries个元素时占用的内存: 每个元素一个节点(next指针和pair), 以及约num_entries个桶
+ */
+static uint64_t hash_map_bytes(uint64_t num_entries, uint64_t pair_size) {
+    uint64_t node = sizeof(void *) + pair_size;
+    uint64_t buckets = num_entries * sizeof(void *);
+    return num_entries * (node + allocation_overhead(node)) + buckets + allocation_overhead(buckets);
+}
+
+/**
+ * @brief 估计vector在逐个push_back num_entries个元素之后占用的堆内存, 容量按2倍增长
+ */
+static uint64_t vector_bytes(uint64_t num_entries, uint64_t element_size) {
+    if (num_entries == 0)
+        return 0;
+    uint64_t capacity = 1;
+    while (capacity < num_entries)
+        capacity *= 2;
+    return capacity * element_size + allocation_overhead(capacity * element_size);
+}
+
+/**
+ * @brief model_footprint的递归部分
+ * @param list (Not Free) 指向model的ModelList, 根节点为nullptr
+ */
+static void model_footprint_recursive(const Model *model, const ModelList *list, int depth, bool recursive, MemoryFootprint *total,
+                                      vector<SubmodelFootprint> *submodels) {
+    SubmodelFootprint entry;
+    entry.model = model;
+    entry.depth = depth;
+    MemoryFootprint &bytes = entry.bytes;
+    bytes.vertices = (uint64_t)model->num_verts * sizeof(Vertex);
+    bytes.faces = (uint64_t)model->num_faces * sizeof(Face);
+    if (model->verts != nullptr)
+        bytes.allocator += allocation_overhead(bytes.vertices);
+    if (model->faces != nullptr)
+        bytes.allocator += allocation_overhead(bytes.faces);
+    for (uint32_t i = 0; i < model->num_faces; i++) {
+        const HEdge *e = model->faces[i].h;
+        if (e == nullptr)
+            continue;
+        do {
+            bytes.hedges += sizeof(HEdge);
+            bytes.pairs += (uint64_t)e->num_paris * sizeof(HEdge *);
+            bytes.allocator += allocation_overhead(sizeof(HEdge));
+            if (e->pairs != nullptr)
+                bytes.allocator += allocation_overhead((uint64_t)e->num_paris * sizeof(HEdge *));
+            e = e->next;
+        } while (e != nullptr && e != model->faces[i].h);
+    }
+    if (list != nullptr) {
+        bytes.model_lists = sizeof(ModelList) + sizeof(Model);
+        bytes.allocator += allocation_overhead(sizeof(ModelList)) + allocation_overhead(sizeof(Model));
+    }
+    if (model->name != nullptr) {
+        bytes.names = strlen(model->name) + 1;
+        bytes.allocator += allocation_overhead(bytes.names);
+    }
+    if (model->bvh != nullptr) {
+        uint64_t nodes = (uint64_t)model->bvh->num_nodes * sizeof(BVHTree);
+        uint64_t surfaces = (uint64_t)model->bvh->num_surfaces * sizeof(FaceSurface);
+        bytes.bvh = sizeof(ModelBVH) + nodes + surfaces;
+        bytes.allocator += allocation_overhead(sizeof(ModelBVH));
+        if (model->bvh->nodes != nullptr)
+            bytes.allocator += allocation_overhead(nodes);
+        if (model->bvh->surfaces != nullptr)
+            bytes.allocator += allocation_overhead(surfaces);
+    }
+    *total += bytes;
+    if (submodels != nullptr)
+        submodels->push_back(entry);
+    if (recursive) {
+        for (const ModelList *model_list = model->submodels; model_list != nullptr; model_list = model_list->next) {
+            if (model_list->model != nullptr)
+                model_footprint_recursive(model_list->model, model_list, depth + 1, recursive, total, submodels);
+        }
+    }
+}
+
+int model_footprint(const Model *model, bool recursive, MemoryFootprint *total, vector<SubmodelFootprint> *submodels) {
+    if (model == nullptr) {
+        return 1;
+    } else if (total == nullptr) {
+        return 2;
+    }
+    *total = MemoryFootprint();
+    model_footprint_recursive(model, nullptr, 0, recursive, total, submodels);
+    return 0;
+}
+
+/**
+ * @brief (No Pointer) estimate_obj_footprint扫描时的统计
+ */
+class ObjStatistics {
+public:
+    uint64_t num_verts = 0;       // 所有v行
+    uint64_t group_verts = 0;     // 当前group内的v行
+    uint64_t group_faces = 0;     // 当前group的f行
+    uint64_t group_refs = 0;      // 当前group的face顶点引用数
+    uint64_t num_groups = 0;      // o/g行
+    uint64_t name_bytes = 0;      // 所有o/g名称及其结束符
+    uint64_t num_faces = 0;       // 所有f行
+    uint64_t num_refs = 0;        // 所有face顶点引用
+    uint64_t model_verts = 0;     // 估计的所有Model的vertices之和
+    uint64_t bvh_nodes = 0;       // 估计的所有BVH节点
+    uint64_t allocator = 0;       // 估计的常驻数据的分配器开销
+    uint64_t face_indices = 0;    // 所有f行解析出的索引vector占用的堆内存
+    vector<uint64_t> group_scratch; // 每个group在构建任务中的临时内存
+    const BVHBuildOptions *bvh_options = nullptr;
+    bool optimize_layout = false;
+};
+
+/**
+ * @brief 结束当前group的统计
+ */
+static void finish_group(ObjStatistics *stats) {
+    if (stats->group_faces > 0) {
+        uint64_t defined = stats->group_verts > 0 ? stats->group_verts : stats->num_verts;
+        uint64_t verts = min(stats->group_refs, defined);
+        uint64_t faces = stats->group_faces;
+        uint64_t refs = stats->group_refs;
+        stats->model_verts += verts;
+        stats->allocator += allocation_overhead(verts * sizeof(Vertex)) + allocation_overhead(faces * sizeof(Face)) +
+                            refs * (allocation_overhead(sizeof(HEdge)) + allocation_overhead(sizeof(HEdge *)));
+        // load_data_to_model的顶点索引表(unordered_map<int, int>)
+        uint64_t load_scratch = hash_map_bytes(verts, 2 * sizeof(int));
+        // calc_pairs按顶点收集HEdges, 每条HEdge出现在两个顶点的vector中
+        uint64_t pairs_scratch = 0;
+        if (verts > 0)
+            pairs_scratch = verts * (sizeof(vector<HEdge *>) + vector_bytes((2 * refs + verts - 1) / verts, sizeof(HEdge *)));
+        // optimize_model_layout重排时新旧两份几何数据同时存在, 另有旧HEdge到新HEdge的哈希表
+        uint64_t layout_scratch = 0;
+        if (stats->optimize_layout)
+            layout_scratch = verts * sizeof(Vertex) + allocation_overhead(verts * sizeof(Vertex)) + faces * sizeof(Face) +
+                             allocation_overhead(faces * sizeof(Face)) +
+                             refs * (sizeof(HEdge) + allocation_overhead(sizeof(HEdge))) +
+                             refs * (sizeof(HEdge *) + allocation_overhead(sizeof(HEdge *))) +
+                             hash_map_bytes(refs, 2 * sizeof(HEdge *));
+        uint64_t bvh_scratch = 0;
+        if (stats->bvh_options != nullptr) {
+            uint64_t references = stats->group_faces;
+            if (stats->bvh_options->split_method == BVHBuildOptions::SPATIAL_SPLIT)
+                references += (uint64_t)(stats->bvh_options->max_reference_growth * stats->group_faces);
+            stats->bvh_nodes += 2 * references - 1;
+            stats->allocator += allocation_overhead((2 * references - 1) * sizeof(BVHTree));
+            stats->allocator += allocation_overhead(faces * sizeof(FaceSurface));
+            // 每个图元引用一个(AABB, FaceSurface *); SAH按预算上限一次分配节点, 构建后再复制到大小恰好的数组
+            bvh_scratch = stats->group_faces * (sizeof(AABB) + sizeof(FaceSurface *));
+            if (stats->bvh_options->split_method != BVHBuildOptions::MEDIAN_SPLIT)
+                bvh_scratch += (2 * references - 1) * sizeof(BVHTree);
+        }
+        stats->group_scratch.push_back(max(max(load_scratch, pairs_scratch), max(layout_scratch, bvh_scratch)));
+    }
+    stats->num_faces += stats->group_faces;
+    stats->num_refs += stats->group_refs;
+    stats->group_verts = 0;
+    stats->group_faces = 0;
+    stats->group_refs = 0;
+}
+
+/**
+ * @brief 统计一行. line不含'\n'
+ */
+static void scan_line(ObjStatistics *stats, const char *line, size_t len) {
+    if (len < 2 || line[1] != ' ')
+        return;
+    if (line[0] == 'v') {
+        stats->num_verts++;
+        stats->group_verts++;
+    } else if (line[0] == 'f') {
+        // 以空白分隔的顶点数量
+        uint64_t refs = 0;
+        bool in_token = false;
+        for (size_t i = 1; i < len; i++) {
+            bool space = line[i] == ' ' || line[i] == '\t' || line[i] == '\r';
+            refs += !space && !in_token;
+            in_token = !space;
+        }
+        stats->group_faces++;
+        stats->group_refs += refs;
+        stats->face_indices += vector_bytes(refs, sizeof(Eigen::Vector3i));
+    } else if (line[0] == 'o' || line[0] == 'g') {
+        finish_group(stats);
+        stats->num_groups++;
+        stats->name_bytes += len - 1; // len - 2个字符和结束符
+        stats->allocator += allocation_overhead(len - 1);
+    }
+}
+
+int estimate_obj_footprint(const char *obj_path, const BVHBuildOptions *bvh_options, int num_threads, bool optimize_layout,
+                           MemoryFootprint *estimate, uint64_t *peak_bytes) {
+    if (obj_path == nullptr) {
+        return 1;
+    } else if (estimate == nullptr) {
+        return 2;
+    }
+    FILE *file = fopen(obj_path, "rb");
+    if (file == nullptr) {
+        return 3;
+    }
+    ObjStatistics stats;
+    stats.bvh_options = bvh_options;
+    stats.optimize_layout = optimize_layout;
+    uint64_t file_size = 0;
+    const size_t CHUNK_SIZE = 1 << 20;
+    vector<char> chunk(CHUNK_SIZE);
+    string pending; // 跨越chunk边界的行
+    size_t n = 0;
+    while ((n = fread(chunk.data(), 1, CHUNK_SIZE, file)) > 0) {
+        file_size += n;
+        const char *begin = chunk.data();
+        const char *end = begin + n;
+        while (begin < end) {
+            const char *newline = (const char *)memchr(begin, '\n', end - begin);
+            if (newline == nullptr) {
+                pending.append(begin, end);
+                break;
+            }
+            if (!pending.empty()) {
+                pending.append(begin, newline);
+                scan_line(&stats, pending.c_str(), pending.size());
+                pending.clear();
+            } else {
+                scan_line(&stats, begin, newline - begin);
+            }
+            begin = newline + 1;
+        }
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed) {
+        return 3;
+    }
+    scan_line(&stats, pending.c_str(), pending.size());
+    finish_group(&stats);
+
+    *estimate = MemoryFootprint();
+    estimate->vertices = stats.model_verts * sizeof(Vertex);
+    estimate->faces = stats.num_faces * sizeof(Face);
+    estimate->hedges = stats.num_refs * sizeof(HEdge);
+    estimate->pairs = stats.num_refs * sizeof(HEdge *);
+    estimate->model_lists = stats.num_groups * (sizeof(ModelList) + sizeof(Model));
+    estimate->names = stats.name_bytes + 5; // 根节点的"root"
+    estimate->allocator = stats.allocator + allocation_overhead(5) +
+                          stats.num_groups * (allocation_overhead(sizeof(ModelList)) + allocation_overhead(sizeof(Model)));
+    if (bvh_options != nullptr) {
+        estimate->bvh = (stats.num_groups + 1) * sizeof(ModelBVH) + stats.bvh_nodes * sizeof(BVHTree) + stats.num_faces * sizeof(FaceSurface);
+        estimate->allocator += (stats.num_groups + 1) * allocation_overhead(sizeof(ModelBVH));
+    }
+    if (peak_bytes != nullptr) {
+        // parse_obj_file_pipelined: 文件内容, 大小恰好的vertices数组, 以及尚未被load_data_to_model读取的faces索引
+        // (每个face一个vector, 每个顶点一个Eigen::Vector3i). 构建比解析慢时, 解析结束时所有groups的索引可能都还在队列中
+        uint64_t transient = file_size + 1 + stats.num_verts * sizeof(Vertex) + stats.num_faces * sizeof(vector<Eigen::Vector3i>) * 2 +
+                             stats.face_indices;
+        // num_threads个构建任务同时进行, 最坏情况下是临时内存最大的几个groups
+        if (num_threads < 1)
+            num_threads = max(1, (int)thread::hardware_concurrency());
+        vector<uint64_t> &scratch = stats.group_scratch;
+        size_t concurrent = min(scratch.size(), (size_t)num_threads);
+        partial_sort(scratch.begin(), scratch.begin() + concurrent, scratch.end(), greater<uint64_t>());
+        for (size_t i = 0; i < concurrent; i++)
+            transient += scratch[i];
+        *peak_bytes = estimate->total() + transient;
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file framebuffer.cpp
+ * @brief framebuffer.h的具体实现
+ */
+#include <algorithm>
+#include <cstring>
+#include <framebuffer.h>
+#include <new>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+void Framebuffer::splat(int x, int y, float r, float g, float b) {
+    atomic<float> *p = splats + pixel_index(x, y) * 4;
+    float values[3] = {r, g, b};
+    for (int c = 0; c < 3; c++) {
+        float expected = p[c].load(memory_order_relaxed);
+        while (!p[c].compare_exchange_weak(expected, expected + values[c], memory_order_relaxed)) {
+        }
+    }
+}
+
+int init_framebuffer(Framebuffer *fb, int width, int height) {
+    if (fb == nullptr) {
+        return 1;
+    } else if (width <= 0 || height <= 0) {
+        return 2;
+    }
+    free_framebuffer(fb);
+    fb->width = width;
+    fb->height = height;
+    fb->num_tiles_x = (width + Framebuffer::TILE_SIZE - 1) / Framebuffer::TILE_SIZE;
+    fb->num_tiles_y = (height + Framebuffer::TILE_SIZE - 1) / Framebuffer::TILE_SIZE;
+    size_t num_floats = (size_t)fb->num_tiles_x * fb->num_tiles_y * Framebuffer::TILE_PIXELS * 4;
+    fb->pixels = new (align_val_t(Framebuffer::ALIGNMENT)) float[num_floats];
+    memset(fb->pixels, 0, num_floats * sizeof(float));
+    fb->splats = new (align_val_t(Framebuffer::ALIGNMENT)) atomic<float>[num_floats];
+    for (size_t i = 0; i < num_floats; i++) {
+        fb->splats[i].store(0, memory_order_relaxed);
+    }
+    return 0;
+}
+
+void free_framebuffer(Framebuffer *fb) {
+    if (fb == nullptr)
+        return;
+    if (fb->pixels != nullptr)
+        operator delete[](fb->pixels, align_val_t(Framebuffer::ALIGNMENT));
+    if (fb->splats != nullptr)
+        operator delete[](fb->splats, align_val_t(Framebuffer::ALIGNMENT));
+    *fb = Framebuffer();
+}
+
+/**
+ * @brief 对一个tile做tonemap和量化: 每个像素RGBA 4个通道都被写入quantized, 第4个通道之后被丢弃
+ * @param pixels (Not Free) 一个tile的RGBA之和
+ * @param splat (Not Free) 一个tile的splat
+ * @param quantized (Not Free) Framebuffer::TILE_PIXELS * 4字节
+ */
+static void quantize_tile(const float *pixels, const float *splat, float splat_scale, uint8_t *quantized) {
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(splat_scale);
+    const __m128 max_value = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128i packed[4];
+    for (int i = 0; i < Framebuffer::TILE_PIXELS; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            __m128 rgba = _mm_load_ps(pixels + (i + j) * 4);
+            __m128 weight = _mm_shuffle_ps(rgba, rgba, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 positive = _mm_cmpgt_ps(weight, zero);
+            weight = _mm_or_ps(_mm_and_ps(positive, weight), _mm_andnot_ps(positive, one)); // 权重为0时除以1
+            __m128 color = _mm_add_ps(_mm_div_ps(rgba, weight), _mm_mul_ps(_mm_load_ps(splat + (i + j) * 4), scale));
+            color = _mm_min_ps(_mm_max_ps(color, zero), one);
+            packed[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(color, max_value), half));
+        }
+        __m128i low = _mm_packs_epi32(packed[0], packed[1]);
+        __m128i high = _mm_packs_epi32(packed[2], packed[3]);
+        _mm_store_si128((__m128i *)(quantized + i * 4), _mm_packus_epi16(low, high));
+    }
+#else
+    for (int i = 0; i < Framebuffer::TILE_PIXELS * 4; i++) {
+        float weight = pixels[i | 3] > 0 ? pixels[i | 3] : 1.0f;
+        float color = pixels[i] / weight + splat[i] * splat_scale;
+        quantized[i] = (uint8_t)(min(max(color, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+#endif
+}
+
+int resolve_framebuffer(const Framebuffer *fb, float splat_scale, uint8_t *buffer) {
+    if (fb == nullptr || buffer == nullptr) {
+        return 1;
+    } else if (fb->pixels == nullptr || fb->splats == nullptr) {
+        return 2;
+    }
+    const int n = Framebuffer::TILE_PIXELS * 4; // floats per tile
+    alignas(Framebuffer::ALIGNMENT) float splat[n];
+    alignas(Framebuffer::ALIGNMENT) uint8_t quantized[n];
+    for (int ty = 0; ty < fb->num_tiles_y; ty++) {
+        for (int tx = 0; tx < fb->num_tiles_x; tx++) {
+            size_t tile = (size_t)ty * fb->num_tiles_x + tx;
+            const atomic<float> *splats = fb->splats + tile * n;
+            for (int i = 0; i < n; i++) {
+                splat[i] = splats[i].load(memory_order_relaxed);
+            }
+            quantize_tile(fb->pixels + tile * n, splat, splat_scale, quantized);
+            // 写回行优先的RGB图像, 丢弃第4个通道和超出画面的部分
+            int x0 = tx * Framebuffer::TILE_SIZE;
+            int y0 = ty * Framebuffer::TILE_SIZE;
+            int x1 = min(x0 + Framebuffer::TILE_SIZE, fb->width);
+            int y1 = min(y0 + Framebuffer::TILE_SIZE, fb->height);
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *src = quantized + (y - y0) * Framebuffer::TILE_SIZE * 4;
+                uint8_t *dst = buffer + ((size_t)y * fb->width + x0) * 3;
+                for (int x = 0; x < x1 - x0; x++) {
+                    dst[x * 3] = src[x * 4];
+                    dst[x * 3 + 1] = src[x * 4 + 1];
+                    dst[x * 3 + 2] = src[x * 4 + 2];
+                }
+            }
+        }
+    }
+    return 0;
+}
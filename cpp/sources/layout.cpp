@@ -0,0 +1,289 @@
+/**
+ * @file layout.cpp
+ * @brief layout.h的具体实现
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <layout.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief 把v的低10位分散到结果的第0, 3, 6, ..., 27位
+ */
+static uint32_t expand_bits_10(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/**
+ * @brief 30位Morton码, x, y, z分别是[0, 1]内的归一化坐标. 超出[0, 1]的坐标会被截断.
+ */
+static uint32_t morton_code_30(float x, float y, float z) {
+    uint32_t ix = (uint32_t)std::min(std::max(x * 1024.0f, 0.0f), 1023.0f);
+    uint32_t iy = (uint32_t)std::min(std::max(y * 1024.0f, 0.0f), 1023.0f);
+    uint32_t iz = (uint32_t)std::min(std::max(z * 1024.0f, 0.0f), 1023.0f);
+    return (expand_bits_10(ix) << 2) | (expand_bits_10(iy) << 1) | expand_bits_10(iz);
+}
+
+/**
+ * @brief 焊接网格的单元坐标. epsilon == 0时直接使用坐标的二进制表示.
+ */
+static int64_t weld_cell(float co, float epsilon) {
+    if (epsilon == 0) {
+        float normalized = co + 0.0f; // -0.0和+0.0视为同一个坐标
+        uint32_t bits = 0;
+        memcpy(&bits, &normalized, sizeof(float));
+        return bits;
+    }
+    double cell = std::floor((double)co / epsilon);
+    cell = std::min(std::max(cell, -1e15), 1e15); // 避免转换为int64_t时溢出
+    return (int64_t)cell;
+}
+
+/**
+ * @brief 把三个单元坐标混合成一个哈希键. 键冲突只影响性能, 焊接时仍会逐个比较坐标.
+ */
+static uint64_t weld_key(int64_t cx, int64_t cy, int64_t cz) {
+    uint64_t h = (uint64_t)cx * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)cy * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= (uint64_t)cz * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    return h;
+}
+
+/**
+ * @brief 计算每个vertex焊接后的代表vertex
+ *
+ * @param model (Not Free)
+ * @param rep 输出, rep[i]是vertex i的代表vertex, rep[rep[i]] == rep[i]
+ * @return 被焊接掉的vertex数量
+ */
+static uint32_t weld_vertices(const Model *model, float weld_epsilon, vector<uint32_t> *rep) {
+    rep->resize(model->num_verts);
+    for (uint32_t i = 0; i < model->num_verts; i++) {
+        (*rep)[i] = i;
+    }
+    if (weld_epsilon < 0) {
+        return 0;
+    }
+    int radius = weld_epsilon == 0 ? 0 : 1;                // 需要搜索的相邻单元半径
+    unordered_map<uint64_t, vector<uint32_t>> grid;        // cell key -> representative vertices
+    grid.reserve(model->num_verts);
+    uint32_t num_welded = 0;
+    for (uint32_t i = 0; i < model->num_verts; i++) {
+        const Eigen::Vector3f &co = model->verts[i].co;
+        int64_t cx = weld_cell(co[0], weld_epsilon);
+        int64_t cy = weld_cell(co[1], weld_epsilon);
+        int64_t cz = weld_cell(co[2], weld_epsilon);
+        bool found = false;
+        for (int dx = -radius; dx <= radius && !found; dx++) {
+            for (int dy = -radius; dy <= radius && !found; dy++) {
+                for (int dz = -radius; dz <= radius && !found; dz++) {
+                    auto cell = grid.find(weld_key(cx + dx, cy + dy, cz + dz));
+                    if (cell == grid.end()) {
+                        continue;
+                    }
+                    for (uint32_t j : cell->second) {
+                        Eigen::Vector3f diff = (model->verts[j].co - co).cwiseAbs();
+                        if (diff.maxCoeff() <= weld_epsilon) {
+                            (*rep)[i] = j;
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        if (found) {
+            num_welded += 1;
+        } else {
+            grid[weld_key(cx, cy, cz)].push_back(i);
+        }
+    }
+    return num_welded;
+}
+
+int optimize_model_layout(Model *model, float weld_epsilon, bool recursive) {
+    if (model == nullptr) {
+        return 1;
+    }
+    if (model->num_faces > 0 && model->num_verts > 0) {
+        // 检查face loops, 同时确认每个HEdge::v都属于model->verts
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            HEdge *e = model->faces[i].h;
+            if (e == nullptr) {
+                continue;
+            }
+            do {
+                if (e->v < model->verts || e->v >= model->verts + model->num_verts) {
+                    return 2;
+                }
+                e = e->next;
+                if (e == nullptr) {
+                    return 2;
+                }
+            } while (e != model->faces[i].h);
+        }
+
+        // (1) 焊接
+        vector<uint32_t> rep; // representative vertex after welding
+        uint32_t num_welded = weld_vertices(model, weld_epsilon, &rep);
+
+        // (2) 按face中心的Morton码排序faces
+        Eigen::Vector3f lo = model->verts[0].co; // lower corner of model bounds
+        Eigen::Vector3f hi = model->verts[0].co; // higher corner of model bounds
+        for (uint32_t i = 1; i < model->num_verts; i++) {
+            lo = lo.cwiseMin(model->verts[i].co);
+            hi = hi.cwiseMax(model->verts[i].co);
+        }
+        Eigen::Vector3f extent = (hi - lo).cwiseMax(Eigen::Vector3f::Constant(1e-20f));
+        vector<pair<uint32_t, uint32_t>> order(model->num_faces); // (morton code, old face index)
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            Eigen::Vector3f center = Eigen::Vector3f::Zero();
+            int num_edges = 0;
+            HEdge *e = model->faces[i].h;
+            if (e != nullptr) {
+                do {
+                    center += model->verts[rep[e->v - model->verts]].co;
+                    num_edges += 1;
+                    e = e->next;
+                } while (e != model->faces[i].h);
+                center /= (float)num_edges;
+            }
+            Eigen::Vector3f n = (center - lo).cwiseQuotient(extent); // normalized center
+            order[i] = {morton_code_30(n[0], n[1], n[2]), i};
+        }
+        std::sort(order.begin(), order.end());
+
+        Face *faces = new Face[model->num_faces];
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            faces[i] = model->faces[order[i].second];
+            faces[i].index = i;
+            HEdge *e = faces[i].h;
+            if (e == nullptr) {
+                continue;
+            }
+            do {
+                e->f = faces + i;
+                e = e->next;
+            } while (e != faces[i].h);
+        }
+
+        // (3) 按首次使用顺序为vertices重新编号
+        const uint32_t unassigned = 0xffffffff;
+        vector<uint32_t> old2new(model->num_verts, unassigned); // old index to new index
+        uint32_t num_verts = 0;
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            HEdge *e = faces[i].h;
+            if (e == nullptr) {
+                continue;
+            }
+            do {
+                uint32_t r = rep[e->v - model->verts];
+                if (old2new[r] == unassigned) {
+                    old2new[r] = num_verts++;
+                }
+                e = e->next;
+            } while (e != faces[i].h);
+        }
+        for (uint32_t i = 0; i < model->num_verts; i++) {
+            if (rep[i] == i && old2new[i] == unassigned) {
+                old2new[i] = num_verts++;
+            }
+        }
+        Vertex *verts = new Vertex[num_verts];
+        for (uint32_t i = 0; i < model->num_verts; i++) {
+            if (rep[i] == i) {
+                verts[old2new[i]] = model->verts[i];
+                verts[old2new[i]].index = old2new[i];
+            }
+        }
+
+        // (4) 修正HEdge::v
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            HEdge *e = faces[i].h;
+            if (e == nullptr) {
+                continue;
+            }
+            do {
+                Vertex *v = verts + old2new[rep[e->v - model->verts]];
+                if (v->h == nullptr) {
+                    v->h = e;
+                }
+                e->v = v;
+                e = e->next;
+            } while (e != faces[i].h);
+        }
+
+        // (5) 按新的face顺序重新分配HEdges和pairs, 使遍历时HEdges也基本连续
+        unordered_map<HEdge *, HEdge *> old2new_hedge; // old HEdge to new HEdge
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            HEdge *e = faces[i].h;
+            if (e == nullptr) {
+                continue;
+            }
+            do {
+                HEdge *relocated = new HEdge(*e);
+                if (e->num_paris > 0) {
+                    relocated->pairs = new HEdge *[e->num_paris];
+                    memcpy(relocated->pairs, e->pairs, sizeof(HEdge *) * e->num_paris);
+                }
+                old2new_hedge.insert({e, relocated});
+                e = e->next;
+            } while (e != faces[i].h);
+        }
+        for (auto p = old2new_hedge.begin(); p != old2new_hedge.end(); p++) {
+            HEdge *e = p->second;
+            e->next = old2new_hedge[e->next];
+            e->prev = old2new_hedge[e->prev];
+            for (int j = 0; j < e->num_paris; j++) {
+                e->pairs[j] = old2new_hedge[e->pairs[j]];
+            }
+        }
+        for (uint32_t i = 0; i < model->num_faces; i++) {
+            if (faces[i].h != nullptr) {
+                faces[i].h = old2new_hedge[faces[i].h];
+            }
+        }
+        for (uint32_t i = 0; i < num_verts; i++) {
+            if (verts[i].h != nullptr) {
+                verts[i].h = old2new_hedge[verts[i].h];
+            }
+        }
+        for (auto p = old2new_hedge.begin(); p != old2new_hedge.end(); p++) {
+            delete[] p->first->pairs;
+            delete p->first;
+        }
+
+        delete[] model->verts;
+        delete[] model->faces;
+        model->verts = verts;
+        model->faces = faces;
+        model->num_verts = num_verts;
+
+        // (6) 焊接可能使原本不相邻的HEdges首尾相接
+        if (num_welded > 0 && calc_pairs(model, false) != 0) {
+            return 3;
+        }
+    }
+    if (recursive) {
+        ModelList *model_list = model->submodels;
+        int submodel_index = 0;
+        while (model_list != nullptr) {
+            int ret = optimize_model_layout(model_list->model, weld_epsilon, recursive);
+            if (ret != 0) {
+                return 100 + submodel_index;
+            }
+            submodel_index++;
+            model_list = model_list->next;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,419 @@
+/**
+ * @file lazyload.cpp
+ * @brief lazyload.h的具体实现
+ */
+#include <algorithm>
+#include <atomic>
+#include <bvh.h>
+#include <collider.h>
+#include <cstring>
+#include <footprint.h>
+#include <fstream>
+#include <layout.h>
+#include <lazyload.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const uint64_t VERTEX_CHUNK_SIZE = 1024; // 每个文件偏移索引覆盖的vertex数量
+
+/**
+ * @brief (Has Pointer) 一个按需加载的submodel, 由ModelList::user_data指向
+ */
+class LazySubmodel {
+public:
+    LazyScene *scene = nullptr;
+    ModelList *model_list = nullptr;
+    uint64_t begin = 0; // submodel在obj文件中的字节范围起点
+    uint64_t end = 0;   // submodel在obj文件中的字节范围终点(不含)
+    bool has_faces = false;
+    AABB aabb = AABB(0, 0, 0, 0, 0, 0);
+    mutex lock;                    // 保护加载, 卸载以及pins, resident, bytes的修改
+    atomic<int> pins{0};           // 锁定次数
+    atomic<bool> resident{false};  // 是否已加载
+    uint64_t bytes = 0;            // 已加载数据的内存估计值
+    atomic<uint64_t> last_used{0}; // 最近一次acquire时scene->clock的值
+};
+
+/**
+ * @brief (Has Pointer)
+ */
+class LazyScene {
+public:
+    string path;
+    uint64_t memory_budget = 0;
+    bool optimize_layout = false;
+    uint64_t num_verts = 0;                // number of vertices in the obj file
+    vector<uint64_t> vertex_chunk_offsets; // 第i * VERTEX_CHUNK_SIZE个vertex所在行的文件偏移
+    vector<LazySubmodel *> submodels;
+    atomic<uint64_t> resident_bytes{0};
+    atomic<uint64_t> clock{0}; // LRU时钟
+    mutex evict_lock;          // 同一时间只有一个线程执行卸载
+};
+
+/**
+ * @brief 从file读取一行, 去掉行尾的'\r', 并把*offset前移读取的字节数
+ */
+static bool read_line(ifstream *file, string *line, uint64_t *offset) {
+    if (!getline(*file, *line)) {
+        return false;
+    }
+    *offset += line->size() + 1;
+    if (!line->empty() && line->back() == '\r') {
+        line->pop_back();
+    }
+    return true;
+}
+
+/**
+ * @brief 从obj文件加载sub->model_list->model的几何数据, 拓扑和BVH. 调用方需持有sub->lock.
+ * @param scene (Not Free)
+ * @param sub (Not Free)
+ * @return 与lazy_acquire相同的状态码
+ */
+static int load_submodel(LazyScene *scene, LazySubmodel *sub) {
+    ifstream file(scene->path, ios::binary);
+    if (!file) {
+        return 3;
+    }
+    // [[v/vt/n, v/vt/n, ..., v/vt/n], ...]; 索引是obj文件中的全局索引, 从0开始
+    vector<vector<Eigen::Vector3i>> faces;
+    string line;
+    uint64_t offset = sub->begin;
+    file.seekg(sub->begin);
+    while (offset < sub->end && read_line(&file, &line, &offset)) {
+        if (line.compare(0, 2, "f ", 2) == 0) {
+            vector<Eigen::Vector3i> face;
+            if (parse_obj_f_line(line.c_str(), &face) != 0) {
+                return 4;
+            }
+            faces.push_back(std::move(face));
+        }
+    }
+
+    // 只读取faces用到的vertices, 按文件偏移索引跳转到所在的块
+    vector<int> needed; // sorted global indices of needed vertices
+    for (auto &face : faces) {
+        for (auto &prop : face) {
+            if (prop[0] < 0 || (uint64_t)prop[0] >= scene->num_verts) {
+                return 4;
+            }
+            needed.push_back(prop[0]);
+        }
+    }
+    std::sort(needed.begin(), needed.end());
+    needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+    vector<Vertex> verts(needed.size());
+    size_t k = 0;
+    while (k < needed.size()) {
+        uint64_t chunk = needed[k] / VERTEX_CHUNK_SIZE;
+        uint64_t vid = chunk * VERTEX_CHUNK_SIZE; // global index of the next vertex line
+        file.clear();
+        file.seekg(scene->vertex_chunk_offsets[chunk]);
+        offset = scene->vertex_chunk_offsets[chunk];
+        while (k < needed.size() && (uint64_t)needed[k] / VERTEX_CHUNK_SIZE == chunk) {
+            if (!read_line(&file, &line, &offset)) {
+                return 4;
+            }
+            if (line.compare(0, 2, "v ", 2) != 0) {
+                continue;
+            }
+            if (vid == (uint64_t)needed[k]) {
+                if (parse_obj_v_line(line.c_str(), &verts[k].co) != 0) {
+                    return 4;
+                }
+                k++;
+            }
+            vid++;
+        }
+    }
+    for (auto &face : faces) {
+        for (auto &prop : face) {
+            prop[0] = (int)(std::lower_bound(needed.begin(), needed.end(), prop[0]) - needed.begin());
+        }
+    }
+
+    Model *m = sub->model_list->model;
+    if (load_data_to_model(m, verts.data(), verts.size(), &faces) != 0) {
+        return 5;
+    }
+    if (scene->optimize_layout && optimize_model_layout(m, -1, false) != 0) {
+        return 6;
+    }
+    int ret = calc_pairs(m, false);
+    if (ret != 0) {
+        return 100 + ret;
+    }
+    if (build_model_bvh(m, false) != 0) {
+        return 7;
+    }
+    return 0;
+}
+
+/**
+ * @brief 卸载sub的几何数据. 调用方需持有sub->lock, 且sub->pins == 0.
+ */
+static void unload_submodel(LazySubmodel *sub) {
+    Model *m = sub->model_list->model;
+    free_model_bvh(m, false);
+    clear_model(m);
+    sub->scene->resident_bytes -= sub->bytes;
+    sub->bytes = 0;
+    sub->resident = false;
+}
+
+/**
+ * @brief 卸载最久未使用且未被锁定的submodels, 直到常驻内存不超过预算或没有可卸载的submodel
+ */
+static void evict(LazyScene *scene) {
+    unique_lock<mutex> evict_guard(scene->evict_lock, try_to_lock);
+    if (!evict_guard.owns_lock()) {
+        return; // 其它线程正在卸载
+    }
+    while (scene->resident_bytes > scene->memory_budget) {
+        LazySubmodel *victim = nullptr;
+        for (LazySubmodel *sub : scene->submodels) {
+            if (sub->resident && sub->pins == 0 && (victim == nullptr || sub->last_used < victim->last_used)) {
+                victim = sub;
+            }
+        }
+        if (victim == nullptr) {
+            return;
+        }
+        lock_guard<mutex> guard(victim->lock);
+        if (victim->resident && victim->pins == 0) {
+            unload_submodel(victim);
+        }
+    }
+}
+
+/**
+ * @brief 新建一个名为name的LazySubmodel, 对应的ModelList加入model->submodels的头部
+ */
+static LazySubmodel *new_submodel(LazyScene *scene, Model *model, const char *name, size_t name_len, uint64_t begin) {
+    Model *m = new Model();
+    m->name = new char[name_len + 1];
+    memcpy(m->name, name, sizeof(char) * name_len);
+    m->name[name_len] = '\0';
+    add_submodel(model, m);
+    LazySubmodel *sub = new LazySubmodel();
+    sub->scene = scene;
+    sub->model_list = model->submodels;
+    sub->model_list->user_data = sub;
+    sub->begin = begin;
+    sub->end = begin;
+    scene->submodels.push_back(sub);
+    return sub;
+}
+
+/**
+ * @brief 释放scene及其LazySubmodels, 不卸载几何数据
+ */
+static void delete_scene(LazyScene *scene) {
+    for (LazySubmodel *sub : scene->submodels) {
+        sub->model_list->user_data = nullptr;
+        delete sub;
+    }
+    delete scene;
+}
+
+int lazy_load_obj(const char *obj_path, uint64_t memory_budget, bool optimize_layout, Model *model, LazyScene **scene) {
+    if (obj_path == nullptr) {
+        return 1;
+    } else if (model == nullptr) {
+        return 2;
+    } else if (scene == nullptr) {
+        return 3;
+    }
+    ifstream file(obj_path, ios::binary);
+    if (!file) {
+        return 4;
+    }
+    LazyScene *s = new LazyScene();
+    s->path = obj_path;
+    s->memory_budget = memory_budget;
+    s->optimize_layout = optimize_layout;
+    vector<Eigen::Vector3f> vert_cos; // vertex coordinates, 只在扫描期间用于计算AABB
+    LazySubmodel *root = nullptr;     // 不属于任一group/object的faces
+    LazySubmodel *cur = nullptr;      // 当前正在扫描的group/object
+    string line;
+    uint64_t offset = 0;
+    uint64_t line_begin = 0;
+    while (read_line(&file, &line, &offset)) {
+        if (line.compare(0, 2, "v ", 2) == 0) {
+            Eigen::Vector3f co;
+            if (parse_obj_v_line(line.c_str(), &co) != 0) {
+                delete_scene(s);
+                return 5;
+            }
+            if (vert_cos.size() % VERTEX_CHUNK_SIZE == 0) {
+                s->vertex_chunk_offsets.push_back(line_begin);
+            }
+            vert_cos.push_back(co);
+        } else if (line.compare(0, 2, "f ", 2) == 0) {
+            vector<Eigen::Vector3i> face;
+            if (parse_obj_f_line(line.c_str(), &face) != 0) {
+                delete_scene(s);
+                return 6;
+            }
+            if (cur == nullptr) {
+                if (root == nullptr) {
+                    root = new_submodel(s, model, "root", 4, 0);
+                }
+                cur = root;
+            }
+            for (auto &prop : face) {
+                if (prop[0] < 0 || (size_t)prop[0] >= vert_cos.size()) {
+                    delete_scene(s);
+                    return 7;
+                }
+                const Eigen::Vector3f &co = vert_cos[prop[0]];
+                AABB point(co[0], co[0], co[1], co[1], co[2], co[2]);
+                cur->aabb = cur->has_faces ? aabb_merge(cur->aabb, point) : point;
+                cur->has_faces = true;
+            }
+            cur->end = offset;
+        } else if (line.compare(0, 2, "o ", 2) == 0 || line.compare(0, 2, "g ", 2) == 0) {
+            cur = new_submodel(s, model, line.c_str() + 2, line.length() - 2, offset);
+        }
+        line_begin = offset;
+    }
+    s->num_verts = vert_cos.size();
+    *scene = s;
+    return 0;
+}
+
+int lazy_acquire(LazyScene *scene, ModelList *model_list) {
+    if (scene == nullptr) {
+        return 1;
+    } else if (model_list == nullptr || model_list->user_data == nullptr) {
+        return 2;
+    }
+    LazySubmodel *sub = (LazySubmodel *)model_list->user_data;
+    if (sub->scene != scene) {
+        return 2;
+    }
+    {
+        lock_guard<mutex> guard(sub->lock);
+        if (!sub->resident) {
+            int ret = load_submodel(scene, sub);
+            if (ret != 0) {
+                free_model_bvh(sub->model_list->model, false);
+                clear_model(sub->model_list->model);
+                return ret;
+            }
+            MemoryFootprint footprint;
+            model_footprint(sub->model_list->model, false, &footprint, nullptr);
+            sub->bytes = footprint.total() - footprint.names; // name在扫描后一直常驻
+            if (footprint.names > 0)
+                sub->bytes -= allocation_overhead(footprint.names);
+            scene->resident_bytes += sub->bytes;
+            sub->resident = true;
+        }
+        sub->pins++;
+        sub->last_used = ++scene->clock;
+    }
+    return 0;
+}
+
+void lazy_release(LazyScene *scene, ModelList *model_list) {
+    if (scene == nullptr || model_list == nullptr || model_list->user_data == nullptr) {
+        return;
+    }
+    LazySubmodel *sub = (LazySubmodel *)model_list->user_data;
+    {
+        lock_guard<mutex> guard(sub->lock);
+        sub->pins--;
+    }
+    if (scene->resident_bytes > scene->memory_budget) {
+        evict(scene);
+    }
+}
+
+int lazy_acquire_frustum(LazyScene *scene, const Frustum &frustum, vector<ModelList *> *pinned) {
+    if (scene == nullptr) {
+        return 1;
+    } else if (pinned == nullptr) {
+        return 2;
+    }
+    size_t num_pinned = pinned->size();
+    for (LazySubmodel *sub : scene->submodels) {
+        if (!sub->has_faces || frustum_aabb_test(frustum, sub->aabb) == 0) {
+            continue;
+        }
+        int ret = lazy_acquire(scene, sub->model_list);
+        if (ret != 0) {
+            for (size_t i = num_pinned; i < pinned->size(); i++) {
+                lazy_release(scene, (*pinned)[i]);
+            }
+            pinned->resize(num_pinned);
+            return 1000 + ret;
+        }
+        pinned->push_back(sub->model_list);
+    }
+    return 0;
+}
+
+void lazy_release_all(LazyScene *scene, vector<ModelList *> *pinned) {
+    if (pinned == nullptr) {
+        return;
+    }
+    for (ModelList *model_list : *pinned) {
+        lazy_release(scene, model_list);
+    }
+    pinned->clear();
+}
+
+bool lazy_ray_hit(LazyScene *scene, const Ray &ray, float t0, float t1, HitRecord *hit_record) {
+    if (hit_record != nullptr)
+        hit_record->hit = false;
+    if (scene == nullptr)
+        return false;
+    bool hit = false;
+    HitRecord record(false, 0);
+    for (LazySubmodel *sub : scene->submodels) {
+        if (!sub->has_faces || !sub->aabb.ray_hit(ray, t0, t1, nullptr)) {
+            continue;
+        }
+        if (lazy_acquire(scene, sub->model_list) != 0) {
+            continue;
+        }
+        const ModelBVH *bvh = sub->model_list->model->bvh;
+        if (bvh != nullptr && bvh_ray_hit(bvh->root, ray, t0, t1, &record)) {
+            hit = true;
+            t1 = record.t;
+            if (hit_record != nullptr)
+                *hit_record = record;
+        }
+        lazy_release(scene, sub->model_list);
+    }
+    return hit;
+}
+
+uint64_t lazy_resident_bytes(const LazyScene *scene) {
+    if (scene == nullptr) {
+        return 0;
+    }
+    return scene->resident_bytes;
+}
+
+int free_lazy_scene(LazyScene *scene) {
+    if (scene == nullptr) {
+        return 1;
+    }
+    for (LazySubmodel *sub : scene->submodels) {
+        if (sub->pins != 0) {
+            return 2;
+        }
+    }
+    for (LazySubmodel *sub : scene->submodels) {
+        lock_guard<mutex> guard(sub->lock);
+        if (sub->resident) {
+            unload_submodel(sub);
+        }
+    }
+    delete_scene(scene);
+    return 0;
+}
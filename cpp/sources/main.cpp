@@ -2,18 +2,784 @@
  * @file main.cpp
  * @brief 用于调试代码
  */
+#include <bvh.h>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <daemon.h>
+#include <distributed.h>
 #include <eigen3/Eigen/Eigen>
+#include <footprint.h>
+#include <framebuffer.h>
+#include <layout.h>
+#include <lazyload.h>
 #include <modeling.h>
+#include <perfcount.h>
+#include <pipeline.h>
 #include <ppm.h>
 #include <ray.h>
+#include <render.h>
+#include <sampler.h>
 #include <stdexcept>
 #include <string>
 #include <surface.h>
 
 using namespace std;
 
-int main() {
+/**
+ * @brief 从argv[0..9]解析<eye xyz> <target xyz> <up xyz> <fov>
+ */
+static Camera parse_camera(char **argv) {
+    Camera camera;
+    camera.eye = Eigen::Vector3f(atof(argv[0]), atof(argv[1]), atof(argv[2]));
+    camera.target = Eigen::Vector3f(atof(argv[3]), atof(argv[4]), atof(argv[5]));
+    camera.up = Eigen::Vector3f(atof(argv[6]), atof(argv[7]), atof(argv[8]));
+    camera.fov = atof(argv[9]);
+    return camera;
+}
+
+/**
+ * @brief (No Pointer) benchmark模式共同的参数
+ */
+class BenchmarkArgs {
+public:
+    const char *obj_path = nullptr;
+    int width = 0;
+    int height = 0;
+    Camera camera;
+};
+
+/**
+ * @brief 解析ray_tracing <mode> <obj> <width> <height> <eye xyz> <target xyz> <up xyz> <fov>, 参数无效时打印用法或错误
+ * @param args (Not Free) 输出
+ * @return 参数有效时返回true
+ */
+static bool parse_benchmark_args(int argc, char **argv, BenchmarkArgs *args) {
+    if (argc != 15) {
+        printf("Usage: %s %s <obj> <width> <height> <eye xyz> <target xyz> <up xyz> <fov>\n", argv[0], argv[1]);
+        return false;
+    }
+    args->obj_path = argv[2];
+    args->width = atoi(argv[3]);
+    args->height = atoi(argv[4]);
+    args->camera = parse_camera(argv + 5);
+    if (args->width <= 0 || args->height <= 0) {
+        printf("Error: invalid image size\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief ray_tracing --render <obj> <ppm> <width> <height> <spp> <eye xyz> <target xyz> <up xyz> <fov> [--lazy <memory budget>] [--layout]
+ * @details 指定--lazy时用lazy_load_obj按需加载submodels, 按32 x 32的tiles渲染, 每个tile锁定一次可见的submodels.
+ *  指定--layout时加载后执行optimize_model_layout (见prepare_model)
+ */
+static int render_once(int argc, char **argv) {
+    bool lazy = false;
+    uint64_t memory_budget = 0;
+    bool optimize_layout = false;
+    bool valid = argc >= 17;
+    for (int i = 17; i < argc && valid; i++) {
+        if (strcmp(argv[i], "--lazy") == 0 && i + 1 < argc && !lazy) {
+            lazy = true;
+            memory_budget = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--layout") == 0 && !optimize_layout) {
+            optimize_layout = true;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("Usage: %s --render <obj> <ppm> <width> <height> <spp> <eye xyz> <target xyz> <up xyz> <fov> [--lazy <memory budget>] "
+               "[--layout]\n",
+               argv[0]);
+        return 1;
+    }
+    int width = atoi(argv[4]);
+    int height = atoi(argv[5]);
+    int spp = atoi(argv[6]);
+    Camera camera = parse_camera(argv + 7);
+    if (width <= 0 || height <= 0) {
+        printf("Error: invalid image size\n");
+        return 1;
+    }
+    Model model = Model();
+    LazyScene *scene = nullptr;
+    int error_code = 0;
+    if (lazy) {
+        error_code = lazy_load_obj(argv[2], memory_budget, optimize_layout, &model, &scene);
+    } else {
+        error_code = parse_obj_file_pipelined(argv[2], &model, 0, optimize_layout);
+    }
+    if (error_code == 0) {
+        Framebuffer framebuffer;
+        init_framebuffer(&framebuffer, width, height);
+        SobolSampler sampler(0);
+        if (scene != nullptr) {
+            const int tile = 32; // Framebuffer::TILE_SIZE的整数倍
+            for (int y = 0; y < height && error_code == 0; y += tile) {
+                for (int x = 0; x < width && error_code == 0; x += tile) {
+                    error_code = render_lazy_tile_to_framebuffer(scene, &camera, &sampler, spp, x, y, min(x + tile, width),
+                                                                 min(y + tile, height), &framebuffer);
+                }
+            }
+            printf("Resident bytes: %llu\n", (unsigned long long)lazy_resident_bytes(scene));
+        } else {
+            error_code = render_tile_to_framebuffer(&model, &camera, &sampler, spp, 0, 0, width, height, &framebuffer);
+        }
+        if (error_code == 0) {
+            uint8_t *image = new uint8_t[(size_t)width * height * 3];
+            resolve_framebuffer(&framebuffer, 0, image);
+            FILE *out = fopen(argv[3], "wb");
+            if (out != nullptr) {
+                write_ppm(out, image, width, height);
+                fclose(out);
+            } else {
+                printf("Cannot open file\n");
+                error_code = 2;
+            }
+            delete[] image;
+        } else {
+            printf("Error: %d\n", error_code);
+        }
+        free_framebuffer(&framebuffer);
+    } else {
+        printf("Error: %d\n", error_code);
+    }
+    // 失败时model中也可能已有部分数据, 同样需要释放
+    if (scene != nullptr) {
+        free_lazy_scene(scene);
+    }
+    free_model_bvh(&model, true);
+    free_model_tree(&model);
+    return error_code;
+}
+
+/**
+ * @brief ray_tracing --coordinator <address> <obj> <ppm> <width> <height> <spp> <eye xyz> <target xyz> <up xyz> <fov> [local workers]
+ *  [tile timeout]
+ * @details tile timeout的单位是秒, 默认120, 0表示不超时
+ */
+static int coordinate(int argc, char **argv) {
+    if (argc < 18 || argc > 20) {
+        printf("Usage: %s --coordinator <address> <obj> <ppm> <width> <height> <spp> <eye xyz> <target xyz> <up xyz> <fov> [local workers] "
+               "[tile timeout]\n",
+               argv[0]);
+        return 1;
+    }
+    Camera camera = parse_camera(argv + 8);
+    int error_code = run_coordinator(argv[2], argv[3], &camera, atoi(argv[5]), atoi(argv[6]), atoi(argv[7]), 32,
+                                     argc >= 19 ? atoi(argv[18]) : 0, argc == 20 ? atoi(argv[19]) : 120, argv[4]);
+    if (error_code != 0) {
+        printf("Error: %d\n", error_code);
+    }
+    return error_code;
+}
+
+/**
+ * @brief ray_tracing --sampler-benchmark <obj> <width> <height> <eye xyz> <target xyz> <up xyz> <fov>
+ * @details 以均匀随机采样器(种子与被比较的采样器不同) 4096 spp的渲染结果为参考, 输出各采样器在1到256 spp下的渲染时间和RMSE (0~255),
+ *  即误差-时间曲线. 参考图像与任何被比较的采样器都不相关, 它自身的噪声约为uniform 256 spp的1/4
+ */
+static int benchmark_samplers(int argc, char **argv) {
+    BenchmarkArgs args;
+    if (!parse_benchmark_args(argc, argv, &args)) {
+        return 1;
+    }
+    int width = args.width;
+    int height = args.height;
+    const Camera &camera = args.camera;
+    Model model = Model();
+    int error_code = parse_obj_file_pipelined(args.obj_path, &model, 0, false);
+    if (error_code != 0) {
+        printf("Error: %d\n", error_code);
+        return error_code;
+    }
+    size_t size = (size_t)width * height * 3;
+    uint8_t *reference = new uint8_t[size];
+    uint8_t *image = new uint8_t[size];
+    UniformSampler reference_sampler(0x5EED);
+    render_tile(&model, &camera, &reference_sampler, width, height, 4096, 0, 0, width, height, reference);
+
+    UniformSampler uniform(1);
+    SobolSampler sobol(1);
+    BlueNoiseSampler blue_noise(1, width);
+    const Sampler *samplers[] = {&uniform, &sobol, &blue_noise};
+    const char *names[] = {"uniform", "sobol", "blue-noise"};
+    printf("%-12s %6s %12s %10s\n", "sampler", "spp", "seconds", "rmse");
+    for (int i = 0; i < 3; i++) {
+        for (int spp = 1; spp <= 256; spp *= 2) {
+            auto start = chrono::steady_clock::now();
+            render_tile(&model, &camera, samplers[i], width, height, spp, 0, 0, width, height, image);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            double error = 0;
+            for (size_t j = 0; j < size; j++) {
+                double d = (double)image[j] - reference[j];
+                error += d * d;
+            }
+            printf("%-12s %6d %12.4f %10.4f\n", names[i], spp, seconds, sqrt(error / size));
+        }
+    }
+    delete[] reference;
+    delete[] image;
+    free_model_bvh(&model, true);
+    free_model_tree(&model);
+    return 0;
+}
+
+/**
+ * @brief 每个像素中心一条primary ray与model求交 (model_ray_hit), 返回所用的秒数
+ * @param hits (Not Free) 相交的射线数量
+ */
+static double time_primary_rays(const Model *model, const Camera &camera, int width, int height, size_t *hits) {
+    float aspect = (float)width / height;
+    *hits = 0;
+    auto start = chrono::steady_clock::now();
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            Ray ray = camera.generate_ray((x + 0.5f) / width, (y + 0.5f) / height, aspect);
+            *hits += model_ray_hit(model, ray, 0, INFINITY, nullptr);
+        }
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief (No Pointer) 拓扑遍历的结果, 与遍历顺序无关, 所以重排前后应完全相同
+ */
+class WalkSignature {
+public:
+    uint64_t faces = 0;  // 遍历的faces数量
+    uint64_t hedges = 0; // 遍历的HEdges数量
+    uint64_t pairs = 0;  // 遍历的pairs数量
+    uint64_t hash = 0;   // 每条HEdge及其pairs的顶点坐标(按位)的散列值之和 (mod 2^64)
+};
+
+/**
+ * @brief 把顶点坐标的位模式散列为64位整数 (splitmix64)
+ */
+static uint64_t hash_position(const Eigen::Vector3f &co) {
+    uint32_t bits[3];
+    memcpy(bits, co.data(), sizeof(bits));
+    uint64_t h = ((uint64_t)bits[0] << 32 | bits[1]) ^ ((uint64_t)bits[2] * 0x9e3779b97f4a7c15ull);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+/**
+ * @brief 按faces的顺序遍历model树中每个face的HEdges, 它们的pairs和顶点坐标, 返回所用的秒数
+ * @param signature (Not Free) 输出, 需要被打印, 否则遍历可能被优化掉
+ */
+static double time_topology_walk(const Model *model, WalkSignature *signature) {
+    auto start = chrono::steady_clock::now();
+    vector<const Model *> stack = {model};
+    while (!stack.empty()) {
+        const Model *m = stack.back();
+        stack.pop_back();
+        for (uint32_t i = 0; i < m->num_faces; i++) {
+            HEdge *h = m->faces[i].h;
+            HEdge *e = h;
+            signature->faces++;
+            do {
+                uint64_t hash = hash_position(e->v->co);
+                for (int j = 0; j < e->num_paris; j++) {
+                    hash += hash_position(e->pairs[j]->v->co) * 3;
+                }
+                signature->hash += hash;
+                signature->hedges++;
+                signature->pairs += e->num_paris;
+                e = e->next;
+            } while (e != nullptr && e != h);
+        }
+        for (ModelList *model_list = m->submodels; model_list != nullptr; model_list = model_list->next) {
+            stack.push_back(model_list->model);
+        }
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief ray_tracing --layout-benchmark <obj> <width> <height> <eye xyz> <target xyz> <up xyz> <fov>
+ * @details 同一个场景分别不经过和经过optimize_model_layout(不焊接)后构建BVH (SPATIAL_SPLIT),
+ *  输出拓扑遍历(faces, HEdges, pairs, 顶点)的时间和每个像素一条primary ray的吞吐量.
+ *  两次的相交数量, 以及遍历到的faces, HEdges, pairs数量和与顺序无关的散列值都应相同.
+ *  硬件计数器可用时还输出两部分各自的最后一级cache misses, 否则输出n/a
+ */
+static int benchmark_layout(int argc, char **argv) {
+    BenchmarkArgs args;
+    if (!parse_benchmark_args(argc, argv, &args)) {
+        return 1;
+    }
+    int width = args.width;
+    int height = args.height;
+    const Camera &camera = args.camera;
+    BVHBuildOptions options;
+    options.split_method = BVHBuildOptions::SPATIAL_SPLIT; // 与prepare_model相同
+    printf("%-10s %12s %12s %12s %12s %12s %10s %10s %10s %18s\n", "layout", "walk (ms)", "walk misses", "rays/s", "ray misses", "hits",
+           "faces", "hedges", "pairs", "walk hash");
+    for (int optimized = 0; optimized < 2; optimized++) {
+        Model model = Model();
+        int error_code = parse_obj_file(args.obj_path, &model);
+        if (error_code == 0 && optimized) {
+            error_code = optimize_model_layout(&model, -1, true);
+        }
+        if (error_code == 0) {
+            error_code = build_model_bvh_with_options(&model, &options, true);
+        }
+        if (error_code != 0) {
+            printf("Error: %d\n", error_code);
+            free_model_bvh(&model, true);
+            free_model_tree(&model);
+            return error_code;
+        }
+        WalkSignature signature;
+        PerfCounter counter;
+        string walk_misses = "n/a", ray_misses = "n/a";
+        uint64_t misses = 0;
+        open_perf_counter(PerfCounter::CACHE_MISSES, &counter);
+        double walk_seconds = time_topology_walk(&model, &signature);
+        if (read_perf_counter(&counter, &misses)) {
+            walk_misses = to_string(misses);
+        }
+        close_perf_counter(&counter);
+        size_t hits = 0;
+        open_perf_counter(PerfCounter::CACHE_MISSES, &counter);
+        double ray_seconds = time_primary_rays(&model, camera, width, height, &hits);
+        if (read_perf_counter(&counter, &misses)) {
+            ray_misses = to_string(misses);
+        }
+        close_perf_counter(&counter);
+        printf("%-10s %12.3f %12s %12.0f %12s %12zu %10llu %10llu %10llu %18llx\n", optimized ? "optimized" : "file", walk_seconds * 1000,
+               walk_misses.c_str(), (double)width * height / ray_seconds, ray_misses.c_str(), hits, (unsigned long long)signature.faces,
+               (unsigned long long)signature.hedges, (unsigned long long)signature.pairs, (unsigned long long)signature.hash);
+        free_model_bvh(&model, true);
+        free_model_tree(&model);
+    }
+    return 0;
+}
+
+/**
+ * @brief 对model树中所有Model::bvh求和: 节点数量写入num_nodes, 返回各BVH的bvh_sah_cost之和
+ */
+static double sum_bvh_sah_cost(const Model *model, const BVHBuildOptions &options, size_t *num_nodes) {
+    double cost = 0;
+    *num_nodes = 0;
+    vector<const Model *> stack = {model};
+    while (!stack.empty()) {
+        const Model *m = stack.back();
+        stack.pop_back();
+        if (m->bvh != nullptr) {
+            cost += bvh_sah_cost(m->bvh->root, options.traversal_cost, options.intersection_cost);
+            *num_nodes += m->bvh->num_nodes;
+        }
+        for (ModelList *model_list = m->submodels; model_list != nullptr; model_list = model_list->next) {
+            stack.push_back(model_list->model);
+        }
+    }
+    return cost;
+}
+
+/**
+ * @brief ray_tracing --bvh-benchmark <obj> <width> <height> <eye xyz> <target xyz> <up xyz> <fov>
+ * @details 场景经过optimize_model_layout(不焊接)后, 依次用MEDIAN_SPLIT, SAH_SPLIT和SPATIAL_SPLIT构建BVH,
+ *  输出构建时间, 节点数量, SAH代价(各Model的bvh_sah_cost之和)和每个像素一条primary ray的吞吐量. 三次的相交数量应相同
+ */
+static int benchmark_bvh(int argc, char **argv) {
+    BenchmarkArgs args;
+    if (!parse_benchmark_args(argc, argv, &args)) {
+        return 1;
+    }
+    int width = args.width;
+    int height = args.height;
+    const Camera &camera = args.camera;
+    Model model = Model();
+    int error_code = parse_obj_file(args.obj_path, &model);
+    if (error_code == 0) {
+        error_code = optimize_model_layout(&model, -1, true);
+    }
+    if (error_code != 0) {
+        printf("Error: %d\n", error_code);
+        free_model_tree(&model);
+        return error_code;
+    }
+    const char *names[] = {"median", "sah", "spatial"};
+    const int methods[] = {BVHBuildOptions::MEDIAN_SPLIT, BVHBuildOptions::SAH_SPLIT, BVHBuildOptions::SPATIAL_SPLIT};
+    printf("%-10s %12s %12s %12s %12s %12s\n", "split", "build (ms)", "nodes", "SAH cost", "rays/s", "hits");
+    for (int i = 0; i < 3; i++) {
+        BVHBuildOptions options;
+        options.split_method = methods[i];
+        auto start = chrono::steady_clock::now();
+        error_code = build_model_bvh_with_options(&model, &options, true); // 会释放上一次的BVH
+        double build_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (error_code != 0) {
+            printf("Error: %d\n", error_code);
+            break;
+        }
+        size_t num_nodes = 0;
+        double cost = sum_bvh_sah_cost(&model, options, &num_nodes);
+        size_t hits = 0;
+        double ray_seconds = time_primary_rays(&model, camera, width, height, &hits);
+        printf("%-10s %12.3f %12zu %12.2f %12.0f %12zu\n", names[i], build_seconds * 1000, num_nodes, cost,
+               (double)width * height / ray_seconds, hits);
+    }
+    free_model_bvh(&model, true);
+    free_model_tree(&model);
+    return error_code;
+}
+
+/**
+ * @brief Moller-Trumbore ray/triangle求交 (Eigen), 即watertight_triangle_hit之前FaceSurface使用的算法, 作为对照
+ */
+static bool moller_trumbore_hit(const Ray &ray, const Eigen::Vector3f &a, const Eigen::Vector3f &b, const Eigen::Vector3f &c, float t0,
+                                float t1) {
+    Eigen::Vector3f e1 = b - a;
+    Eigen::Vector3f e2 = c - a;
+    Eigen::Vector3f p = ray.d.cross(e2);
+    float det = e1.dot(p);
+    if (det == 0)
+        return false;
+    float inv_det = 1.0f / det;
+    Eigen::Vector3f s = ray.o - a;
+    float u = s.dot(p) * inv_det;
+    if (u < 0 || u > 1)
+        return false;
+    Eigen::Vector3f q = s.cross(e1);
+    float v = ray.d.dot(q) * inv_det;
+    if (v < 0 || u + v > 1)
+        return false;
+    float t = e2.dot(q) * inv_det;
+    return t >= t0 && t <= t1;
+}
+
+/**
+ * @brief 把model树中所有Model::bvh的节点和三角形(每个face的前三个顶点)追加到nodes和triangles
+ */
+static void collect_kernel_inputs(const Model *model, vector<const AABB *> *nodes, vector<const Eigen::Vector3f *> *triangles) {
+    if (model->bvh != nullptr) {
+        for (uint32_t i = 0; i < model->bvh->num_nodes; i++) {
+            nodes->push_back(&model->bvh->nodes[i].aabb);
+        }
+    }
+    for (uint32_t i = 0; i < model->num_faces; i++) {
+        HEdge *h = model->faces[i].h;
+        triangles->push_back(&h->v->co);
+        triangles->push_back(&h->next->v->co);
+        triangles->push_back(&h->next->next->v->co);
+    }
+    for (ModelList *model_list = model->submodels; model_list != nullptr; model_list = model_list->next) {
+        collect_kernel_inputs(model_list->model, nodes, triangles);
+    }
+}
+
+/**
+ * @brief ray_tracing --intersect-benchmark <obj> <width> <height> <eye xyz> <target xyz> <up xyz> <fov>
+ * @details 每个像素中心一条primary ray, 分别与场景中均匀抽取的256个BVH节点和256个三角形求交,
+ *  输出各内核的吞吐量和相交数量: AABB::ray_hit (每次测试都预计算射线) 与aabb_ray_slab (每条射线预计算一次),
+ *  Moller-Trumbore与watertight_triangle_hit, 以及完整BVH遍历(model_ray_hit). 硬件计数器可用时还输出每次测试的指令数
+ */
+static int benchmark_intersection(int argc, char **argv) {
+    BenchmarkArgs args;
+    if (!parse_benchmark_args(argc, argv, &args)) {
+        return 1;
+    }
+    int width = args.width;
+    int height = args.height;
+    const Camera &camera = args.camera;
+    Model model = Model();
+    int error_code = parse_obj_file_pipelined(args.obj_path, &model, 0, false);
+    if (error_code != 0) {
+        printf("Error: %d\n", error_code);
+        return error_code;
+    }
+    vector<const AABB *> all_nodes;
+    vector<const Eigen::Vector3f *> all_triangles;
+    collect_kernel_inputs(&model, &all_nodes, &all_triangles);
+    const size_t num_samples = 256;
+    vector<const AABB *> nodes;
+    vector<const Eigen::Vector3f *> triangles;
+    for (size_t i = 0; i < num_samples && !all_nodes.empty(); i++) {
+        nodes.push_back(all_nodes[i * all_nodes.size() / num_samples]);
+    }
+    size_t num_triangles = all_triangles.size() / 3;
+    for (size_t i = 0; i < num_samples && num_triangles > 0; i++) {
+        size_t k = i * num_triangles / num_samples;
+        triangles.insert(triangles.end(), all_triangles.begin() + k * 3, all_triangles.begin() + k * 3 + 3);
+    }
+    vector<Ray> rays;
+    float aspect = (float)width / height;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            rays.push_back(camera.generate_ray((x + 0.5f) / width, (y + 0.5f) / height, aspect));
+        }
+    }
+
+    printf("%-28s %12s %10s %12s %12s\n", "kernel", "tests", "ns/test", "instr/test", "hits");
+    // 计时并统计body中退休的指令数; 硬件计数器不可用时指令数输出n/a
+    auto measure = [](const char *name, size_t tests, auto body) {
+        PerfCounter counter;
+        open_perf_counter(PerfCounter::INSTRUCTIONS, &counter);
+        auto start = chrono::steady_clock::now();
+        size_t hits = body();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        uint64_t instructions = 0;
+        char per_test[32] = "n/a";
+        if (read_perf_counter(&counter, &instructions)) {
+            snprintf(per_test, sizeof(per_test), "%.1f", (double)instructions / tests);
+        }
+        close_perf_counter(&counter);
+        printf("%-28s %12zu %10.2f %12s %12zu\n", name, tests, seconds * 1e9 / tests, per_test, hits);
+    };
+    measure("AABB::ray_hit", rays.size() * nodes.size(), [&] {
+        size_t hits = 0;
+        for (const Ray &ray : rays) {
+            for (const AABB *aabb : nodes) {
+                hits += aabb->ray_hit(ray, 0, INFINITY, nullptr);
+            }
+        }
+        return hits;
+    });
+    measure("aabb_ray_slab", rays.size() * nodes.size(), [&] {
+        size_t hits = 0;
+        for (const Ray &ray : rays) {
+            PrecomputedRay precomputed(ray);
+            for (const AABB *aabb : nodes) {
+                hits += aabb_ray_slab(precomputed, *aabb, 0, INFINITY, nullptr);
+            }
+        }
+        return hits;
+    });
+    measure("moller_trumbore", rays.size() * triangles.size() / 3, [&] {
+        size_t hits = 0;
+        for (const Ray &ray : rays) {
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                hits += moller_trumbore_hit(ray, *triangles[i], *triangles[i + 1], *triangles[i + 2], 0, INFINITY);
+            }
+        }
+        return hits;
+    });
+    measure("watertight_triangle_hit", rays.size() * triangles.size() / 3, [&] {
+        size_t hits = 0;
+        for (const Ray &ray : rays) {
+            PrecomputedRay precomputed(ray);
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                hits += watertight_triangle_hit(precomputed, *triangles[i], *triangles[i + 1], *triangles[i + 2], 0, INFINITY, nullptr);
+            }
+        }
+        return hits;
+    });
+    measure("model_ray_hit (per ray)", rays.size(), [&] {
+        size_t hits = 0;
+        for (const Ray &ray : rays) {
+            hits += model_ray_hit(&model, ray, 0, INFINITY, nullptr);
+        }
+        return hits;
+    });
+    free_model_bvh(&model, true);
+    free_model_tree(&model);
+    return 0;
+}
+
+/**
+ * @brief 按类别打印footprint
+ */
+static void print_footprint(const char *title, const MemoryFootprint &f) {
+    printf("%-10s total %12llu  vertices %10llu  faces %10llu  hedges %10llu  pairs %10llu  model_lists %8llu  names %6llu  bvh %10llu  "
+           "allocator %10llu\n",
+           title, (unsigned long long)f.total(), (unsigned long long)f.vertices, (unsigned long long)f.faces,
+           (unsigned long long)f.hedges, (unsigned long long)f.pairs, (unsigned long long)f.model_lists, (unsigned long long)f.names,
+           (unsigned long long)f.bvh, (unsigned long long)f.allocator);
+}
+
+/**
+ * @brief ray_tracing --footprint <obj> [threads]
+ * @details 先打印加载前的估计值, 再用parse_obj_file_pipelined完整加载(同--render)并打印实际值和每个submodel的内存(字节).
+ *  threads是构建线程数量, 默认为0 (hardware_concurrency)
+ */
+static int report_footprint(int argc, char **argv) {
+    if (argc != 3 && argc != 4) {
+        printf("Usage: %s --footprint <obj> [threads]\n", argv[0]);
+        return 1;
+    }
+    int num_threads = argc == 4 ? atoi(argv[3]) : 0;
+    BVHBuildOptions options;
+    options.split_method = BVHBuildOptions::SPATIAL_SPLIT; // 与prepare_model相同
+    MemoryFootprint estimate;
+    uint64_t peak = 0;
+    int error_code = estimate_obj_footprint(argv[2], &options, num_threads, false, &estimate, &peak);
+    if (error_code != 0) {
+        printf("Error: %d\n", error_code);
+        return error_code;
+    }
+    print_footprint("estimate", estimate);
+    printf("%-10s peak  %12llu\n", "estimate", (unsigned long long)peak);
+
+    Model model = Model();
+    error_code = parse_obj_file_pipelined(argv[2], &model, num_threads, false);
+    if (error_code != 0) {
+        printf("Error: %d\n", error_code);
+        free_model_bvh(&model, true);
+        free_model_tree(&model);
+        return error_code;
+    }
+    MemoryFootprint total;
+    vector<SubmodelFootprint> submodels;
+    model_footprint(&model, true, &total, &submodels);
+    print_footprint("actual", total);
+    for (const SubmodelFootprint &entry : submodels) {
+        printf("%*s%s: %llu\n", entry.depth * 2, "", entry.model->name == nullptr ? "(null)" : entry.model->name,
+               (unsigned long long)entry.bytes.total());
+    }
+    free_model_bvh(&model, true);
+    free_model_tree(&model);
+    return 0;
+}
+
+/**
+ * @brief 按faces和HEdges的顺序散列一个Model自身(不包括submodels)的顶点坐标和pairs数量, 与WalkSignature不同, 结果依赖于顺序
+ */
+static uint64_t ordered_topology_hash(const Model *model) {
+    uint64_t hash = 0;
+    for (uint32_t i = 0; i < model->num_faces; i++) {
+        HEdge *h = model->faces[i].h;
+        HEdge *e = h;
+        do {
+            hash = hash * 0x100000001b3ull + hash_position(e->v->co) + (uint64_t)e->num_paris;
+            e = e->next;
+        } while (e != nullptr && e != h);
+    }
+    return hash;
+}
+
+/**
+ * @brief 比较两个Model自身(不包括submodels)的名字, 顶点和face数量, 各类别的内存以及ordered_topology_hash, 不同时打印出来
+ */
+static bool same_submodel(const SubmodelFootprint &expected, const SubmodelFootprint &actual) {
+    const Model *a = expected.model;
+    const Model *b = actual.model;
+    const MemoryFootprint &x = expected.bytes;
+    const MemoryFootprint &y = actual.bytes;
+    bool same_name = (a->name == nullptr) == (b->name == nullptr) && (a->name == nullptr || strcmp(a->name, b->name) == 0);
+    uint64_t hash_a = ordered_topology_hash(a);
+    uint64_t hash_b = ordered_topology_hash(b);
+    if (same_name && expected.depth == actual.depth && a->num_verts == b->num_verts && a->num_faces == b->num_faces && hash_a == hash_b &&
+        x.vertices == y.vertices && x.faces == y.faces && x.hedges == y.hedges && x.pairs == y.pairs && x.model_lists == y.model_lists &&
+        x.names == y.names && x.bvh == y.bvh && x.allocator == y.allocator) {
+        return true;
+    }
+    printf("  mismatch at %s: verts %u/%u faces %u/%u hash %llx/%llx\n", a->name == nullptr ? "(null)" : a->name, a->num_verts,
+           b->num_verts, a->num_faces, b->num_faces, (unsigned long long)hash_a, (unsigned long long)hash_b);
+    print_footprint("  expected", x);
+    print_footprint("  actual", y);
+    return false;
+}
+
+/**
+ * @brief ray_tracing --pipeline-check <obj>
+ * @details 检查parse_obj_file_pipelined与parse_obj_file + prepare_model的结果相同 (应使用有多个objects/groups的obj):
+ *  对optimize_layout为false和true, 以及1, 2, 4个构建线程, 逐个submodel(先序)比较名字, 顶点和face数量, 各类别的内存(包括BVH)
+ *  和按顺序的拓扑散列, 并比较整棵树拓扑遍历的WalkSignature. 全部相同时返回0, 否则返回1
+ */
+static int check_pipeline(int argc, char **argv) {
+    if (argc != 3) {
+        printf("Usage: %s --pipeline-check <obj>\n", argv[0]);
+        return 1;
+    }
+    static const int THREADS[] = {1, 2, 4};
+    bool passed = true;
+    for (int optimize_layout = 0; optimize_layout < 2; optimize_layout++) {
+        Model expected = Model();
+        int error_code = parse_obj_file(argv[2], &expected);
+        if (error_code == 0) {
+            error_code = prepare_model(&expected, optimize_layout);
+        }
+        if (error_code != 0) {
+            printf("Error: %d\n", error_code);
+            free_model_bvh(&expected, true);
+            free_model_tree(&expected);
+            return error_code;
+        }
+        MemoryFootprint expected_total;
+        vector<SubmodelFootprint> expected_submodels;
+        model_footprint(&expected, true, &expected_total, &expected_submodels);
+        WalkSignature expected_signature;
+        time_topology_walk(&expected, &expected_signature);
+        for (int num_threads : THREADS) {
+            Model model = Model();
+            error_code = parse_obj_file_pipelined(argv[2], &model, num_threads, optimize_layout);
+            bool same = error_code == 0;
+            if (same) {
+                MemoryFootprint total;
+                vector<SubmodelFootprint> submodels;
+                model_footprint(&model, true, &total, &submodels);
+                same = submodels.size() == expected_submodels.size();
+                for (size_t i = 0; same && i < submodels.size(); i++) {
+                    same = same_submodel(expected_submodels[i], submodels[i]);
+                }
+                WalkSignature signature;
+                time_topology_walk(&model, &signature);
+                if (signature.faces != expected_signature.faces || signature.hedges != expected_signature.hedges ||
+                    signature.pairs != expected_signature.pairs || signature.hash != expected_signature.hash) {
+                    printf("  walk signature mismatch: %llx/%llx\n", (unsigned long long)expected_signature.hash,
+                           (unsigned long long)signature.hash);
+                    same = false;
+                }
+            }
+            if (error_code != 0) {
+                printf("layout %d threads %d: error %d\n", optimize_layout, num_threads, error_code);
+            } else {
+                printf("layout %d threads %d submodels %zu: %s\n", optimize_layout, num_threads, expected_submodels.size(),
+                       same ? "ok" : "FAILED");
+            }
+            passed = passed && same;
+            free_model_bvh(&model, true);
+            free_model_tree(&model);
+        }
+        free_model_bvh(&expected, true);
+        free_model_tree(&expected);
+    }
+    return passed ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "--render") == 0) {
+        return render_once(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--coordinator") == 0) {
+        return coordinate(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--footprint") == 0) {
+        return report_footprint(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--pipeline-check") == 0) {
+        return check_pipeline(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--sampler-benchmark") == 0) {
+        return benchmark_samplers(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--bvh-benchmark") == 0) {
+        return benchmark_bvh(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--layout-benchmark") == 0) {
+        return benchmark_layout(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--intersect-benchmark") == 0) {
+        return benchmark_intersection(argc, argv);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--worker") == 0) {
+        return run_worker(argv[2]);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--daemon") == 0) {
+        // ray_tracing --daemon <socket path> [threads] [scene cache bytes, 默认1 GiB]
+        int error_code = run_render_daemon(argv[2], argc >= 4 ? atoi(argv[3]) : 0, argc >= 5 ? strtoull(argv[4], nullptr, 10) : 1ull << 30);
+        if (error_code != 0) {
+            printf("Error: %d\n", error_code);
+        }
+        return error_code;
+    }
     FILE *file = fopen("C:\\Users\\chenh\\Desktop\\untitled5.obj", "r");
     if (file == nullptr) {
         printf("Cannot open file\n");
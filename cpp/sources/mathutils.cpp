@@ -16,5 +16,7 @@ float solve_one_variable_linear(float A, float B, int *num_solution) {
             *num_solution = 0;
         return NAN;
     }
+    if (num_solution != nullptr)
+        *num_solution = 1;
     return -B / A;
 }
@@ -3,6 +3,8 @@
  * @brief
  */
 // #include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <modeling.h>
 #include <sstream>
 #include <stdexcept>
@@ -13,20 +15,6 @@
 
 using namespace std;
 
-/**
- * @brief 从verts和faces搜集Model数据, 加载至m
- *
- * @param m 待加载的模型
- * @param verts Vertices
- * @param faces [[v/vt/n, v/vt/n, ..., v/vt/n], [v/vt/n, v/vt/n, ..., v/vt/n], ...]; 索引从0开始; 如果vt, n不存在, 用-1代替
- * @return int 状态码: \n
- *  [0] succeeded \n
- *  [1] m == nullptr \n
- *  [2] verts == nullptr \n
- *  [3] faces == nullptr
- */
-int load_data_to_model(Model *m, const vector<Vertex> *verts, const vector<vector<Eigen::Vector3i>> *faces);
-
 int add_submodel(Model *model, Model *submodel) {
     if (model == nullptr) {
         return 1;
@@ -60,30 +48,11 @@ int parse_obj(const char *obj_file, Model *model) {
     Model *m = model; // 当前正在解析的的object/group
     while (getline(ss, line, '\n')) {
         if (line.compare(0, 2, "v ", 2) == 0) {
-            stringstream tmp_ss(line.c_str() + 2); // temporary stringstream
-            size_t offset = 2;
-            size_t parsed_len = 0;                             // parsed length
-            Eigen::Vector4f vert_co = Eigen::Vector4f::Ones(); // vertex coordinates
-            for (int i = 0; i < 4; i++) {
-                try {
-                    vert_co[i] = std::stof(line.c_str() + offset, &parsed_len);
-                    offset += parsed_len;
-                } catch (std::invalid_argument e) {
-                    if (i == 3)
-                        break;
-                    return 3;
-                } catch (std::out_of_range e) {
-                    return 4;
-                }
-            }
-            Eigen::Vector3f vert_co_div(vert_co[0] / vert_co[3], vert_co[1] / vert_co[3],
-                                        vert_co[2] / vert_co[3]); // vertex coordinates divided (by w)
-            if (std::isinf(vert_co_div[0]) || std::isinf(vert_co_div[1]) || std::isinf(vert_co_div[2]) || std::isnan(vert_co_div[0]) ||
-                std::isnan(vert_co_div[1]) || std::isnan(vert_co_div[2])) {
-                return 4;
-            }
             Vertex v;
-            v.co = vert_co_div;
+            int ret = parse_obj_v_line(line.c_str(), &v.co);
+            if (ret != 0) {
+                return ret;
+            }
             verts.push_back(v);
         } else if (line.compare(0, 3, "vt ", 3) == 0) {
             // printf("Found tex_coord: %s\n", line.c_str());
@@ -91,44 +60,16 @@ int parse_obj(const char *obj_file, Model *model) {
             // printf("Found normal: %s\n", line.c_str());
         } else if (line.compare(0, 2, "f ", 2) == 0) {
             // printf("Found face: %s\n", line.c_str());
-            stringstream line_ss(line.c_str() + 2); // line stringstream
-            string word;
             vector<Eigen::Vector3i> face;
-            int num_verts_parsed = 0; // number of parsed vertices
-            while (getline(line_ss, word, ' ')) {
-                stringstream word_ss(word.c_str());                        // word stringstream
-                string idx_string;                                         // index string of vertex, texture coordinate, normal
-                int num_prop_parsed = 0;                                   // number of properties parsed for current vertex
-                Eigen::Vector3i vertex_prop = Eigen::Vector3i(-1, -1, -1); // vertex properties
-                while (getline(word_ss, idx_string, '/')) {
-                    if (num_prop_parsed >= 3) {
-                        // stop parsing if 3 properties has already been parsed
-                        return 5;
-                    }
-                    try {
-                        if (!idx_string.empty()) {
-                            vertex_prop[num_prop_parsed] = std::atoi(idx_string.c_str()) - 1;
-                        }
-                    } catch (std::invalid_argument e) {
-                        return 6;
-                    } catch (std::out_of_range e) {
-                        return 7;
-                    }
-                    num_prop_parsed += 1;
-                }
-                if (num_prop_parsed < 1) {
-                    return 8;
-                }
-                num_verts_parsed += 1;
-                face.push_back(vertex_prop);
-            }
-            if (num_verts_parsed >= 3) {
-                faces.push_back(std::move(face));
-            } else {
-                return 10;
+            int ret = parse_obj_f_line(line.c_str(), &face);
+            if (ret != 0) {
+                return ret;
             }
+            faces.push_back(std::move(face));
         } else if (line.compare(0, 2, "o ", 2) == 0 || line.compare(0, 2, "g ", 2) == 0) {
-            load_data_to_model(m, &verts, &faces);
+            if (load_data_to_model(m, verts.data(), verts.size(), &faces) != 0) {
+                return 9;
+            }
             m = new Model();
             int name_len = line.length() - 2;
             char *name = new char[name_len + 1];
@@ -139,21 +80,124 @@ int parse_obj(const char *obj_file, Model *model) {
             faces.clear();
         }
     }
-    if (!faces.empty()) {
-        load_data_to_model(m, &verts, &faces);
+    if (!faces.empty() && load_data_to_model(m, verts.data(), verts.size(), &faces) != 0) {
+        return 9;
     }
     int ret = calc_pairs(model, true);
     if (ret != 0) {
         return ret + 100;
     }
-    model->name = "root";
+    model->name = new char[5];
+    memcpy(model->name, "root", sizeof(char) * 5);
     return 0;
 }
 
-int load_data_to_model(Model *m, const vector<Vertex> *verts, const vector<vector<Eigen::Vector3i>> *faces) {
+int parse_obj_file(const char *obj_path, Model *model) {
+    if (obj_path == nullptr) {
+        return 1;
+    } else if (model == nullptr) {
+        return 2;
+    }
+    FILE *file = fopen(obj_path, "rb");
+    if (file == nullptr) {
+        return 1000;
+    }
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return 1000;
+    }
+    long file_len = ftell(file);
+    if (file_len < 0) {
+        fclose(file);
+        return 1000;
+    }
+    char *obj_file = new char[file_len + 1];
+    fseek(file, 0, SEEK_SET);
+    size_t read_len = fread(obj_file, sizeof(char), file_len, file);
+    fclose(file);
+    obj_file[read_len] = '\0';
+    int ret = parse_obj(obj_file, model);
+    delete[] obj_file;
+    return ret;
+}
+
+int parse_obj_v_line(const char *line, Eigen::Vector3f *co) {
+    if (line == nullptr) {
+        return 1;
+    } else if (co == nullptr) {
+        return 2;
+    }
+    size_t offset = 2;
+    size_t parsed_len = 0;                             // parsed length
+    Eigen::Vector4f vert_co = Eigen::Vector4f::Ones(); // vertex coordinates
+    for (int i = 0; i < 4; i++) {
+        try {
+            vert_co[i] = std::stof(line + offset, &parsed_len);
+            offset += parsed_len;
+        } catch (std::invalid_argument e) {
+            if (i == 3)
+                break;
+            return 3;
+        } catch (std::out_of_range e) {
+            return 4;
+        }
+    }
+    Eigen::Vector3f vert_co_div(vert_co[0] / vert_co[3], vert_co[1] / vert_co[3],
+                                vert_co[2] / vert_co[3]); // vertex coordinates divided (by w)
+    if (std::isinf(vert_co_div[0]) || std::isinf(vert_co_div[1]) || std::isinf(vert_co_div[2]) || std::isnan(vert_co_div[0]) ||
+        std::isnan(vert_co_div[1]) || std::isnan(vert_co_div[2])) {
+        return 4;
+    }
+    *co = vert_co_div;
+    return 0;
+}
+
+int parse_obj_f_line(const char *line, vector<Eigen::Vector3i> *face) {
+    if (line == nullptr) {
+        return 1;
+    } else if (face == nullptr) {
+        return 2;
+    }
+    stringstream line_ss(line + 2); // line stringstream
+    string word;
+    int num_verts_parsed = 0; // number of parsed vertices
+    while (getline(line_ss, word, ' ')) {
+        stringstream word_ss(word.c_str());                        // word stringstream
+        string idx_string;                                         // index string of vertex, texture coordinate, normal
+        int num_prop_parsed = 0;                                   // number of properties parsed for current vertex
+        Eigen::Vector3i vertex_prop = Eigen::Vector3i(-1, -1, -1); // vertex properties
+        while (getline(word_ss, idx_string, '/')) {
+            if (num_prop_parsed >= 3) {
+                // stop parsing if 3 properties has already been parsed
+                return 5;
+            }
+            try {
+                if (!idx_string.empty()) {
+                    vertex_prop[num_prop_parsed] = std::atoi(idx_string.c_str()) - 1;
+                }
+            } catch (std::invalid_argument e) {
+                return 6;
+            } catch (std::out_of_range e) {
+                return 7;
+            }
+            num_prop_parsed += 1;
+        }
+        if (num_prop_parsed < 1) {
+            return 8;
+        }
+        num_verts_parsed += 1;
+        face->push_back(vertex_prop);
+    }
+    if (num_verts_parsed < 3) {
+        return 10;
+    }
+    return 0;
+}
+
+int load_data_to_model(Model *m, const Vertex *verts, uint32_t num_verts, const vector<vector<Eigen::Vector3i>> *faces) {
     if (m == nullptr) {
         return 1;
-    } else if (verts == nullptr) {
+    } else if (verts == nullptr && num_verts > 0) {
         return 2;
     } else if (faces == nullptr) {
         return 3;
@@ -162,9 +206,13 @@ int load_data_to_model(Model *m, const vector<Vertex> *verts, const vector<vecto
     unordered_map<int, int> old2new; // old index to new index
     for (int i = 0; i < faces->size(); i++) {
         for (int j = 0; j < (*faces)[i].size(); j++) {
-            if (old2new.find((*faces)[i][j][0]) == old2new.end()) {
+            int old_index = (*faces)[i][j][0];
+            if (old_index < 0 || (uint32_t)old_index >= num_verts) {
+                return 4;
+            }
+            if (old2new.find(old_index) == old2new.end()) {
                 // not already seen
-                old2new.insert({(*faces)[i][j][0], old2new.size()});
+                old2new.insert({old_index, old2new.size()});
             }
         }
     }
@@ -173,7 +221,7 @@ int load_data_to_model(Model *m, const vector<Vertex> *verts, const vector<vecto
     if (m->num_verts > 0) {
         m->verts = new Vertex[m->num_verts];
         for (auto p = old2new.begin(); p != old2new.end(); p++) {
-            m->verts[p->second] = (*verts)[p->first];
+            m->verts[p->second] = verts[p->first];
             m->verts[p->second].index = p->second;
         }
     }
@@ -208,6 +256,68 @@ int load_data_to_model(Model *m, const vector<Vertex> *verts, const vector<vecto
     return 0;
 }
 
+int clear_model(Model *model) {
+    if (model == nullptr) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < model->num_faces; i++) {
+        HEdge *e = model->faces[i].h;
+        if (e == nullptr) {
+            continue;
+        }
+        do {
+            e = e->next;
+            if (e == nullptr) {
+                return 2;
+            }
+        } while (e != model->faces[i].h);
+    }
+    for (uint32_t i = 0; i < model->num_faces; i++) {
+        HEdge *e = model->faces[i].h;
+        if (e == nullptr) {
+            continue;
+        }
+        e->prev->next = nullptr; // 断开环, 逐个释放
+        while (e != nullptr) {
+            HEdge *next = e->next;
+            delete[] e->pairs;
+            delete e;
+            e = next;
+        }
+    }
+    delete[] model->verts;
+    delete[] model->faces;
+    model->verts = nullptr;
+    model->faces = nullptr;
+    model->num_verts = 0;
+    model->num_faces = 0;
+    return 0;
+}
+
+int free_model_tree(Model *model) {
+    if (model == nullptr) {
+        return 1;
+    }
+    if (clear_model(model) != 0) {
+        return 2;
+    }
+    ModelList *model_list = model->submodels;
+    while (model_list != nullptr) {
+        ModelList *next = model_list->next;
+        int ret = free_model_tree(model_list->model);
+        if (ret != 0) {
+            return ret;
+        }
+        delete model_list->model;
+        delete model_list;
+        model_list = next;
+        model->submodels = next;
+    }
+    delete[] model->name;
+    model->name = nullptr;
+    return 0;
+}
+
 int calc_pairs(Model *model, bool recursive) {
     if (model == nullptr) {
         return 1;
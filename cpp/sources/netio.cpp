@@ -0,0 +1,320 @@
+/**
+ * @file netio.cpp
+ * @brief netio.h的具体实现
+ */
+#include <netio.h>
+
+#ifdef _WIN32
+
+int listen_address(const char *address, int *fd) { return 4; }
+
+int connect_address(const char *address, int *fd) { return 4; }
+
+void unlink_address(const char *address) {}
+
+void enable_keepalive(int fd) {}
+
+bool recv_line(int fd, std::string *line, size_t max_length) { return false; }
+
+bool recv_line_before(int fd, std::string *line, size_t max_length, std::chrono::steady_clock::time_point deadline) { return false; }
+
+bool recv_all(int fd, void *data, size_t size) { return false; }
+
+bool recv_all_before(int fd, void *data, size_t size, std::chrono::steady_clock::time_point deadline) { return false; }
+
+bool send_all(int fd, const void *data, size_t size) { return false; }
+
+#else
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // 调用方需自行忽略SIGPIPE
+#endif
+
+/**
+ * @brief 把"tcp:<host>:<port>"解析为addrinfo链表, 需要调用freeaddrinfo释放
+ * @param info (Not Free) 输出 (Allocate Ret)
+ * @return 0表示成功
+ */
+static int resolve_tcp(const char *address, bool passive, addrinfo **info) {
+    const char *host = address + 4;
+    const char *colon = strrchr(host, ':');
+    if (colon == nullptr || colon == host || colon[1] == '\0') {
+        return 2;
+    }
+    string host_name(host, colon - host);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    if (getaddrinfo(host_name.c_str(), colon + 1, &hints, info) != 0) {
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * @brief 把"unix:<path>"解析为sockaddr_un
+ * @return 0表示成功
+ */
+static int resolve_unix(const char *address, sockaddr_un *addr) {
+    const char *path = address + 5;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (path[0] == '\0' || strlen(path) >= sizeof(addr->sun_path)) {
+        return 2;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief 如果addr->sun_path已存在, 确认它是没有进程监听的socket后删除
+ * @return 0表示path不存在或已删除, 否则为listen_address的状态码
+ */
+static int remove_stale_socket(const sockaddr_un *addr) {
+    struct stat st;
+    if (lstat(addr->sun_path, &st) != 0) {
+        return errno == ENOENT ? 0 : 3;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        return 5;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return 3;
+    }
+    bool in_use = connect(probe, (const sockaddr *)addr, sizeof(*addr)) == 0;
+    close(probe);
+    if (in_use) {
+        return 6;
+    }
+    unlink(addr->sun_path);
+    return 0;
+}
+
+int listen_address(const char *address, int *fd) {
+    if (address == nullptr || fd == nullptr) {
+        return 1;
+    }
+    if (strncmp(address, "unix:", 5) == 0) {
+        sockaddr_un addr;
+        if (resolve_unix(address, &addr) != 0) {
+            return 2;
+        }
+        int ret = remove_stale_socket(&addr);
+        if (ret != 0) {
+            return ret;
+        }
+        int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s < 0) {
+            return 3;
+        }
+        if (bind(s, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(s, 64) != 0) {
+            close(s);
+            return 3;
+        }
+        *fd = s;
+        return 0;
+    }
+    if (strncmp(address, "tcp:", 4) == 0) {
+        addrinfo *info = nullptr;
+        if (resolve_tcp(address, true, &info) != 0) {
+            return 2;
+        }
+        int ret = 3;
+        for (addrinfo *p = info; p != nullptr; p = p->ai_next) {
+            int s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if (s < 0) {
+                continue;
+            }
+            int one = 1;
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(s, p->ai_addr, p->ai_addrlen) == 0 && listen(s, 64) == 0) {
+                *fd = s;
+                ret = 0;
+                break;
+            }
+            close(s);
+        }
+        freeaddrinfo(info);
+        return ret;
+    }
+    return 2;
+}
+
+int connect_address(const char *address, int *fd) {
+    if (address == nullptr || fd == nullptr) {
+        return 1;
+    }
+    if (strncmp(address, "unix:", 5) == 0) {
+        sockaddr_un addr;
+        if (resolve_unix(address, &addr) != 0) {
+            return 2;
+        }
+        int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s < 0) {
+            return 3;
+        }
+        if (connect(s, (sockaddr *)&addr, sizeof(addr)) != 0) {
+            close(s);
+            return 3;
+        }
+        *fd = s;
+        return 0;
+    }
+    if (strncmp(address, "tcp:", 4) == 0) {
+        addrinfo *info = nullptr;
+        if (resolve_tcp(address, false, &info) != 0) {
+            return 2;
+        }
+        int ret = 3;
+        for (addrinfo *p = info; p != nullptr; p = p->ai_next) {
+            int s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if (s < 0) {
+                continue;
+            }
+            if (connect(s, p->ai_addr, p->ai_addrlen) == 0) {
+                int one = 1;
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // 请求都是短消息
+                enable_keepalive(s);
+                *fd = s;
+                ret = 0;
+                break;
+            }
+            close(s);
+        }
+        freeaddrinfo(info);
+        return ret;
+    }
+    return 2;
+}
+
+void unlink_address(const char *address) {
+    struct stat st;
+    if (address != nullptr && strncmp(address, "unix:", 5) == 0 && lstat(address + 5, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(address + 5);
+    }
+}
+
+void enable_keepalive(int fd) {
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+#ifdef TCP_KEEPIDLE
+    // 对Unix domain socket会失败, 忽略即可
+    int idle = 10, interval = 5, count = 3;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
+
+/**
+ * @brief recv一次. deadline不为nullptr时先poll到fd可读, 到达deadline时返回-1
+ */
+static ssize_t recv_once(int fd, void *data, size_t size, const chrono::steady_clock::time_point *deadline) {
+    while (deadline != nullptr) {
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(*deadline - chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            return -1;
+        }
+        pollfd p;
+        p.fd = fd;
+        p.events = POLLIN;
+        p.revents = 0;
+        int n = poll(&p, 1, (int)min<long long>(remaining, 1 << 30));
+        if (n > 0) {
+            break; // 可读, 或者连接已关闭/出错, 交给下面的recv报告
+        }
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    while (true) {
+        ssize_t n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n;
+    }
+}
+
+/**
+ * @brief recv_line和recv_line_before的实现, deadline可以是nullptr
+ */
+static bool recv_line_impl(int fd, string *line, size_t max_length, const chrono::steady_clock::time_point *deadline) {
+    char c = 0;
+    while (line->size() < max_length) {
+        if (recv_once(fd, &c, 1, deadline) <= 0) {
+            return false;
+        }
+        if (c == '\n') {
+            if (!line->empty() && line->back() == '\r') {
+                line->pop_back();
+            }
+            return true;
+        }
+        line->push_back(c);
+    }
+    return false;
+}
+
+/**
+ * @brief recv_all和recv_all_before的实现, deadline可以是nullptr
+ */
+static bool recv_all_impl(int fd, void *data, size_t size, const chrono::steady_clock::time_point *deadline) {
+    char *p = (char *)data;
+    while (size > 0) {
+        ssize_t n = recv_once(fd, p, size, deadline);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool recv_line(int fd, string *line, size_t max_length) { return recv_line_impl(fd, line, max_length, nullptr); }
+
+bool recv_line_before(int fd, string *line, size_t max_length, chrono::steady_clock::time_point deadline) {
+    return recv_line_impl(fd, line, max_length, &deadline);
+}
+
+bool recv_all(int fd, void *data, size_t size) { return recv_all_impl(fd, data, size, nullptr); }
+
+bool recv_all_before(int fd, void *data, size_t size, chrono::steady_clock::time_point deadline) {
+    return recv_all_impl(fd, data, size, &deadline);
+}
+
+bool send_all(int fd, const void *data, size_t size) {
+    const char *p = (const char *)data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+#endif // _WIN32
@@ -0,0 +1,79 @@
+/**
+ * @file perfcount.cpp
+ * @brief perfcount.h的具体实现
+ */
+#include <perfcount.h>
+
+#ifndef __linux__
+
+int open_perf_counter(int event, PerfCounter *counter) {
+    if (counter == nullptr) {
+        return 1;
+    }
+    counter->fd = -1;
+    return event == PerfCounter::INSTRUCTIONS || event == PerfCounter::CACHE_MISSES ? 3 : 2;
+}
+
+bool read_perf_counter(const PerfCounter *counter, uint64_t *value) { return false; }
+
+void close_perf_counter(PerfCounter *counter) {}
+
+#else
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int open_perf_counter(int event, PerfCounter *counter) {
+    if (counter == nullptr) {
+        return 1;
+    }
+    counter->fd = -1;
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    if (event == PerfCounter::INSTRUCTIONS) {
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    } else if (event == PerfCounter::CACHE_MISSES) {
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    } else {
+        return 2;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // perf_event_paranoid = 2时只允许统计用户态
+    attr.exclude_hv = 1;
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        return 3;
+    }
+    if (ioctl(fd, PERF_EVENT_IOC_RESET, 0) != 0 || ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) != 0) {
+        close(fd);
+        return 3;
+    }
+    counter->fd = fd;
+    return 0;
+}
+
+bool read_perf_counter(const PerfCounter *counter, uint64_t *value) {
+    if (counter == nullptr || value == nullptr || counter->fd < 0) {
+        return false;
+    }
+    uint64_t count = 0;
+    if (read(counter->fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) {
+        return false;
+    }
+    *value = count;
+    return true;
+}
+
+void close_perf_counter(PerfCounter *counter) {
+    if (counter != nullptr && counter->fd >= 0) {
+        close(counter->fd);
+        counter->fd = -1;
+    }
+}
+
+#endif // __linux__
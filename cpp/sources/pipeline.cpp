@@ -0,0 +1,161 @@
+/**
+ * @file pipeline.cpp
+ * @brief pipeline.h的具体实现
+ */
+#include <bvh.h>
+#include <cstdio>
+#include <cstring>
+#include <layout.h>
+#include <pipeline.h>
+#include <threadpool.h>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief (Has Pointer) 一个object/group的构建任务
+ */
+class GroupJob {
+public:
+    Model *model = nullptr;
+    vector<vector<Eigen::Vector3i>> faces; // 同load_data_to_model
+    uint32_t num_verts = 0;                // 提交时已解析的顶点数量
+    bool optimize_layout = false;          // 见parse_obj_file_pipelined
+    int status = 0;                        // 构建的状态码, 见parse_obj_file_pipelined
+};
+
+/**
+ * @brief 在线程池中构建一个object/group. verts的前job->num_verts个元素已解析完, 之后的元素可能正在被写入
+ */
+static int build_group(const Vertex *verts, GroupJob *job) {
+    if (load_data_to_model(job->model, verts, job->num_verts, &job->faces) != 0) {
+        return 9;
+    }
+    vector<vector<Eigen::Vector3i>>().swap(job->faces); // 尽早释放
+    int ret = calc_pairs(job->model, false);
+    if (ret != 0) {
+        return 100 + ret;
+    }
+    if (job->optimize_layout && optimize_model_layout(job->model, -1, false) != 0) {
+        return 11;
+    }
+    BVHBuildOptions options;
+    options.split_method = BVHBuildOptions::SPATIAL_SPLIT; // 与prepare_model相同
+    if (build_model_bvh_with_options(job->model, &options, false) != 0) {
+        return 12;
+    }
+    return 0;
+}
+
+/**
+ * @brief 读取整个文件, 以null character结尾
+ * @return (Allocate Ret) 文件内容, 失败时返回nullptr
+ */
+static char *read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return nullptr;
+    }
+    long file_len = ftell(file);
+    if (file_len < 0) {
+        fclose(file);
+        return nullptr;
+    }
+    char *content = new char[file_len + 1];
+    fseek(file, 0, SEEK_SET);
+    *length = fread(content, sizeof(char), file_len, file);
+    fclose(file);
+    content[*length] = '\0';
+    return content;
+}
+
+int parse_obj_file_pipelined(const char *obj_path, Model *model, int num_threads, bool optimize_layout) {
+    if (obj_path == nullptr) {
+        return 1;
+    } else if (model == nullptr) {
+        return 2;
+    }
+    size_t length = 0;
+    char *content = read_file(obj_path, &length);
+    if (content == nullptr) {
+        return 1000;
+    }
+    char *content_end = content + length;
+    uint32_t num_verts = 0;
+    for (char *line = content; line < content_end;) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            num_verts++;
+        }
+        char *eol = (char *)memchr(line, '\n', content_end - line);
+        line = eol == nullptr ? content_end : eol + 1;
+    }
+    Vertex *verts = new Vertex[num_verts];
+    uint32_t num_parsed = 0; // 已解析的顶点数量
+
+    int ret = 0;
+    vector<GroupJob *> jobs; // 按在文件中出现的顺序
+    ThreadPool pool(num_threads);
+    auto submit = [&](GroupJob *job) {
+        job->num_verts = num_parsed;
+        job->optimize_layout = optimize_layout;
+        pool.submit([verts, job] { job->status = build_group(verts, job); });
+    };
+    GroupJob *current = new GroupJob(); // 当前正在解析的object/group
+    current->model = model;
+    jobs.push_back(current);
+    for (char *line = content; line < content_end;) {
+        char *eol = (char *)memchr(line, '\n', content_end - line);
+        char *next = eol == nullptr ? content_end : eol + 1;
+        if (eol != nullptr) {
+            *eol = '\0';
+        }
+        if (strncmp(line, "v ", 2) == 0) {
+            ret = parse_obj_v_line(line, &verts[num_parsed].co);
+            if (ret != 0) {
+                break;
+            }
+            num_parsed++;
+        } else if (strncmp(line, "f ", 2) == 0) {
+            vector<Eigen::Vector3i> face;
+            ret = parse_obj_f_line(line, &face);
+            if (ret != 0) {
+                break;
+            }
+            current->faces.push_back(std::move(face));
+        } else if (strncmp(line, "o ", 2) == 0 || strncmp(line, "g ", 2) == 0) {
+            submit(current);
+            Model *m = new Model();
+            size_t name_len = strlen(line) - 2;
+            m->name = new char[name_len + 1];
+            memcpy(m->name, line + 2, sizeof(char) * name_len);
+            m->name[name_len] = '\0';
+            add_submodel(model, m);
+            current = new GroupJob();
+            current->model = m;
+            jobs.push_back(current);
+        }
+        line = next;
+    }
+    if (ret == 0) {
+        submit(current);
+    }
+    pool.wait();
+    for (GroupJob *job : jobs) {
+        if (ret == 0 && job->status != 0) {
+            ret = job->status;
+        }
+        delete job;
+    }
+    delete[] verts;
+    delete[] content;
+    if (ret != 0) {
+        return ret;
+    }
+    model->name = new char[5];
+    memcpy(model->name, "root", sizeof(char) * 5);
+    return 0;
+}
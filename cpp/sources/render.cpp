@@ -0,0 +1,261 @@
+/**
+ * @file render.cpp
+ * @brief render.h的具体实现
+ */
+#include <algorithm>
+#include <bvh.h>
+#include <cmath>
+#include <layout.h>
+#include <render.h>
+
+static const uint32_t MAX_TILE_CANDIDATES = 8; // 每个Model在一个tile内最多保留的候选子树数量
+
+Ray Camera::generate_ray(float u, float v, float aspect) const {
+    Eigen::Vector3f w = (target - eye).normalized();          // forward
+    Eigen::Vector3f r = w.cross(up).normalized();             // right
+    Eigen::Vector3f s = r.cross(w);                           // screen up
+    float half_h = std::tan(fov * 3.14159265f / 360.0f);      // half height of the film at distance 1
+    float half_w = half_h * aspect;                           // half width of the film at distance 1
+    Eigen::Vector3f d = w + (2 * u - 1) * half_w * r + (1 - 2 * v) * half_h * s;
+    return Ray(eye, d.normalized());
+}
+
+Frustum Camera::frustum(float u0, float v0, float u1, float v1, float aspect) const {
+    // 胶片四个角对应的射线方向, 按逆时针顺序(从eye看向target时): 左上, 左下, 右下, 右上
+    Eigen::Vector3f corners[4] = {generate_ray(u0, v0, aspect).d, generate_ray(u0, v1, aspect).d, generate_ray(u1, v1, aspect).d,
+                                  generate_ray(u1, v0, aspect).d};
+    Eigen::Vector3f center = generate_ray((u0 + u1) / 2, (v0 + v1) / 2, aspect).d;
+    Frustum frustum;
+    for (int i = 0; i < 4; i++) {
+        Eigen::Vector3f n = corners[i].cross(corners[(i + 1) % 4]);
+        if (n.dot(center) < 0)
+            n = -n;
+        frustum.normals[i] = n;
+        frustum.offsets[i] = -n.dot(eye);
+    }
+    Eigen::Vector3f w = (target - eye).normalized();
+    frustum.normals[4] = w; // near plane
+    frustum.offsets[4] = -w.dot(eye);
+    frustum.num_planes = 5;
+    return frustum;
+}
+
+/**
+ * @brief cull_model_tile的递归部分. rotation, translation是model空间到根模型空间的变换
+ */
+static void cull_model_tile_recursive(const Model *model, const Frustum &frustum, const Eigen::Matrix3f &rotation,
+                                      const Eigen::Vector3f &translation, TileCandidates *candidates) {
+    if (model == nullptr)
+        return;
+    if (model->bvh != nullptr && model->bvh->root != nullptr) {
+        // 根模型空间的平面n.dot(p) + d >= 0, 在model空间中为(R^T n).dot(p) + (n.dot(T) + d) >= 0
+        Frustum local = frustum;
+        for (int i = 0; i < frustum.num_planes; i++) {
+            local.normals[i] = rotation.transpose() * frustum.normals[i];
+            local.offsets[i] = frustum.offsets[i] + frustum.normals[i].dot(translation);
+        }
+        TileCandidateModel entry;
+        entry.rotation = rotation;
+        entry.translation = translation;
+        entry.begin = (uint32_t)candidates->nodes.size();
+        bvh_frustum_cull(model->bvh->root, local, MAX_TILE_CANDIDATES, &candidates->nodes);
+        entry.end = (uint32_t)candidates->nodes.size();
+        if (entry.end > entry.begin)
+            candidates->models.push_back(entry);
+    }
+    for (ModelList *model_list = model->submodels; model_list != nullptr; model_list = model_list->next) {
+        cull_model_tile_recursive(model_list->model, frustum, rotation * model_list->rotation,
+                                  rotation * model_list->translation + translation, candidates);
+    }
+}
+
+void cull_model_tile(const Model *model, const Frustum &frustum, TileCandidates *candidates) {
+    candidates->models.clear();
+    candidates->nodes.clear();
+    cull_model_tile_recursive(model, frustum, Eigen::Matrix3f::Identity(), Eigen::Vector3f::Zero(), candidates);
+}
+
+bool tile_ray_hit(const TileCandidates *candidates, const Ray &ray, float t0, float t1, HitRecord *hit_record) {
+    if (hit_record != nullptr)
+        hit_record->hit = false;
+    bool hit = false;
+    HitRecord record(false, 0);
+    for (const TileCandidateModel &entry : candidates->models) {
+        // rotation是正交矩阵, 变换前后t不变
+        PrecomputedRay local(Ray(entry.rotation.transpose() * (ray.o - entry.translation), entry.rotation.transpose() * ray.d));
+        for (uint32_t i = entry.begin; i < entry.end; i++) {
+            if (bvh_ray_hit(candidates->nodes[i], local, t0, t1, &record)) {
+                hit = true;
+                t1 = record.t;
+                if (hit_record != nullptr) {
+                    *hit_record = record;
+                    hit_record->normal = entry.rotation * record.normal;
+                }
+            }
+        }
+    }
+    return hit;
+}
+
+bool model_ray_hit(const Model *model, const Ray &ray, float t0, float t1, HitRecord *hit_record) {
+    if (hit_record != nullptr)
+        hit_record->hit = false;
+    if (model == nullptr)
+        return false;
+    bool hit = false;
+    HitRecord record(false, 0);
+    if (model->bvh != nullptr && bvh_ray_hit(model->bvh->root, ray, t0, t1, &record)) {
+        hit = true;
+        t1 = record.t;
+        if (hit_record != nullptr)
+            *hit_record = record;
+    }
+    for (ModelList *model_list = model->submodels; model_list != nullptr; model_list = model_list->next) {
+        // rotation是正交矩阵, 变换前后t不变
+        Ray local(model_list->rotation.transpose() * (ray.o - model_list->translation), model_list->rotation.transpose() * ray.d);
+        if (model_ray_hit(model_list->model, local, t0, t1, &record)) {
+            hit = true;
+            t1 = record.t;
+            if (hit_record != nullptr) {
+                *hit_record = record;
+                hit_record->normal = model_list->rotation * record.normal;
+            }
+        }
+    }
+    return hit;
+}
+
+int prepare_model(Model *model, bool optimize_layout) {
+    if (model == nullptr) {
+        return 1;
+    }
+    if (optimize_layout && optimize_model_layout(model, -1, true) != 0) {
+        return 2;
+    }
+    BVHBuildOptions options;
+    options.split_method = BVHBuildOptions::SPATIAL_SPLIT;
+    if (build_model_bvh_with_options(model, &options, true) != 0) {
+        return 3;
+    }
+    return 0;
+}
+
+/**
+ * @brief 包含[x0, x1) x [y0, y1)内所有像素的射线的frustum
+ */
+static Frustum tile_frustum(const Camera *camera, int width, int height, int x0, int y0, int x1, int y1) {
+    float aspect = (float)width / height;
+    // 向外扩展半个像素, 避免浮点误差裁掉边缘射线
+    return camera->frustum((x0 - 0.5f) / width, (y0 - 0.5f) / height, (x1 + 0.5f) / width, (y1 + 0.5f) / height, aspect);
+}
+
+/**
+ * @brief 渲染[x0, x1) x [y0, y1)的像素, 每个像素完成后调用output(x, y, color), color是spp个样本的颜色之和
+ * @details 参数已经过检查, candidates已用tile_frustum裁剪
+ */
+template <typename Output>
+static void trace_tile(const TileCandidates &candidates, const Camera *camera, const Sampler *sampler, int width, int height, int spp,
+                       int x0, int y0, int x1, int y1, Output output) {
+    float aspect = (float)width / height;
+    HitRecord record(false, 0);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            uint32_t pixel = (uint32_t)(y * width + x);
+            Eigen::Vector3f color = Eigen::Vector3f::Zero();
+            for (int i = 0; i < spp; i++) {
+                float u = (x + sampler->sample(pixel, i, 0)) / width;
+                float v = (y + sampler->sample(pixel, i, 1)) / height;
+                Ray ray = camera->generate_ray(u, v, aspect);
+                if (tile_ray_hit(&candidates, ray, 0, INFINITY, &record)) {
+                    float shade = 0.1f + 0.9f * std::fabs(record.normal.dot(ray.d)); // headlight
+                    color += Eigen::Vector3f(shade, shade, shade);
+                } else {
+                    color += Eigen::Vector3f(0.05f, 0.05f, 0.1f + 0.2f * (1 - v)); // background
+                }
+            }
+            output(x, y, color);
+        }
+    }
+}
+
+int render_tile(const Model *model, const Camera *camera, const Sampler *sampler, int width, int height, int spp, int x0, int y0,
+                int x1, int y1, uint8_t *buffer) {
+    if (model == nullptr) {
+        return 1;
+    } else if (camera == nullptr) {
+        return 2;
+    } else if (buffer == nullptr) {
+        return 3;
+    } else if (width <= 0 || height <= 0 || spp <= 0) {
+        return 4;
+    } else if (x0 < 0 || y0 < 0 || x1 > width || y1 > height || x0 >= x1 || y0 >= y1) {
+        return 5;
+    } else if (sampler == nullptr) {
+        return 6;
+    }
+    TileCandidates candidates;
+    cull_model_tile(model, tile_frustum(camera, width, height, x0, y0, x1, y1), &candidates);
+    trace_tile(candidates, camera, sampler, width, height, spp, x0, y0, x1, y1, [&](int x, int y, Eigen::Vector3f color) {
+        // 与resolve_framebuffer的量化方式相同
+        color /= (float)spp;
+        uint8_t *p = buffer + ((y - y0) * (x1 - x0) + (x - x0)) * 3;
+        for (int c = 0; c < 3; c++) {
+            p[c] = (uint8_t)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    });
+    return 0;
+}
+
+int render_tile_to_framebuffer(const Model *model, const Camera *camera, const Sampler *sampler, int spp, int x0, int y0, int x1, int y1,
+                               Framebuffer *fb) {
+    if (model == nullptr) {
+        return 1;
+    } else if (camera == nullptr) {
+        return 2;
+    } else if (fb == nullptr || fb->pixels == nullptr) {
+        return 3;
+    } else if (spp <= 0) {
+        return 4;
+    } else if (x0 < 0 || y0 < 0 || x1 > fb->width || y1 > fb->height || x0 >= x1 || y0 >= y1) {
+        return 5;
+    } else if (sampler == nullptr) {
+        return 6;
+    }
+    TileCandidates candidates;
+    cull_model_tile(model, tile_frustum(camera, fb->width, fb->height, x0, y0, x1, y1), &candidates);
+    trace_tile(candidates, camera, sampler, fb->width, fb->height, spp, x0, y0, x1, y1,
+               [&](int x, int y, const Eigen::Vector3f &color) { fb->add(x, y, color[0], color[1], color[2], (float)spp); });
+    return 0;
+}
+
+int render_lazy_tile_to_framebuffer(LazyScene *scene, const Camera *camera, const Sampler *sampler, int spp, int x0, int y0, int x1,
+                                    int y1, Framebuffer *fb) {
+    if (scene == nullptr) {
+        return 1;
+    } else if (camera == nullptr) {
+        return 2;
+    } else if (fb == nullptr || fb->pixels == nullptr) {
+        return 3;
+    } else if (spp <= 0) {
+        return 4;
+    } else if (x0 < 0 || y0 < 0 || x1 > fb->width || y1 > fb->height || x0 >= x1 || y0 >= y1) {
+        return 5;
+    } else if (sampler == nullptr) {
+        return 6;
+    }
+    Frustum frustum = tile_frustum(camera, fb->width, fb->height, x0, y0, x1, y1);
+    std::vector<ModelList *> pinned;
+    int ret = lazy_acquire_frustum(scene, frustum, &pinned);
+    if (ret != 0) {
+        return 100 + ret;
+    }
+    // pinned中的submodels在lazy_release_all之前不会被卸载, 之后的求交不再加锁
+    TileCandidates candidates;
+    for (ModelList *model_list : pinned) {
+        cull_model_tile_recursive(model_list->model, frustum, model_list->rotation, model_list->translation, &candidates);
+    }
+    trace_tile(candidates, camera, sampler, fb->width, fb->height, spp, x0, y0, x1, y1,
+               [&](int x, int y, const Eigen::Vector3f &color) { fb->add(x, y, color[0], color[1], color[2], (float)spp); });
+    lazy_release_all(scene, &pinned);
+    return 0;
+}
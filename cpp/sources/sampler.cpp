@@ -0,0 +1,241 @@
+/**
+ * @file sampler.cpp
+ * @brief sampler.h的具体实现
+ * @details Owen scrambling使用Burley 2020, "Practical Hash-based Owen Scrambling"中的方法.
+ */
+#include <cmath>
+#include <mutex>
+#include <sampler.h>
+#include <vector>
+
+using namespace std;
+
+static const int SOBOL_DIMENSIONS = 4;  // 直接使用的Sobol维度数量
+static const int BLUE_NOISE_SIZE = 64;  // 蓝噪声纹理边长
+static const int BLUE_NOISE_BITS = 6;   // log2(BLUE_NOISE_SIZE)
+
+/**
+ * @brief 32位整数哈希 (lowbias32)
+ */
+static uint32_t hash_u32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * @brief 把两个32位整数混合成一个哈希值
+ */
+static uint32_t hash_combine(uint32_t seed, uint32_t v) { return hash_u32(seed ^ (v + 0x9E3779B9u + (seed << 6) + (seed >> 2))); }
+
+/**
+ * @brief 把32位整数映射到[0, 1). 只使用高24位, 保证结果严格小于1
+ */
+static float to_unit_float(uint32_t x) { return (x >> 8) * (1.0f / 16777216.0f); }
+
+static uint32_t reverse_bits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/**
+ * @brief Laine-Karras置换: 每一位只受更低位影响
+ */
+static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return x;
+}
+
+/**
+ * @brief 以base-2 Owen scrambling的方式置换x: 每一位只受更高位影响
+ */
+static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+/**
+ * @brief (No Pointer) Sobol序列前SOBOL_DIMENSIONS维的direction numbers (Joe-Kuo)
+ */
+class SobolDirections {
+public:
+    uint32_t v[SOBOL_DIMENSIONS][32];
+
+    SobolDirections() {
+        const uint32_t s[SOBOL_DIMENSIONS] = {0, 1, 2, 3};         // degree of the primitive polynomial
+        const uint32_t a[SOBOL_DIMENSIONS] = {0, 0, 1, 1};         // coefficients of the primitive polynomial
+        const uint32_t m[SOBOL_DIMENSIONS][3] = {{0, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}}; // initial direction numbers
+        for (int i = 0; i < 32; i++) {
+            v[0][i] = 1u << (31 - i);
+        }
+        for (int d = 1; d < SOBOL_DIMENSIONS; d++) {
+            for (uint32_t i = 0; i < 32; i++) {
+                if (i < s[d]) {
+                    v[d][i] = m[d][i] << (31 - i);
+                    continue;
+                }
+                v[d][i] = v[d][i - s[d]] ^ (v[d][i - s[d]] >> s[d]);
+                for (uint32_t k = 1; k < s[d]; k++) {
+                    if ((a[d] >> (s[d] - 1 - k)) & 1) {
+                        v[d][i] ^= v[d][i - k];
+                    }
+                }
+            }
+        }
+    }
+};
+
+static const SobolDirections SOBOL_DIRECTIONS;
+
+/**
+ * @brief Sobol序列第index个点的第dimension维 (dimension < SOBOL_DIMENSIONS), 32位定点数
+ */
+static uint32_t sobol(uint32_t index, int dimension) {
+    uint32_t x = 0;
+    for (int i = 0; index != 0; i++, index >>= 1) {
+        if (index & 1) {
+            x ^= SOBOL_DIRECTIONS.v[dimension][i];
+        }
+    }
+    return x;
+}
+
+/**
+ * @brief shuffled + Owen-scrambled Sobol, 32位定点数
+ */
+static uint32_t owen_sobol(uint32_t index, uint32_t dimension, uint32_t seed) {
+    uint32_t group_seed = hash_combine(seed, dimension / SOBOL_DIMENSIONS);
+    uint32_t shuffled = nested_uniform_scramble(index, group_seed);
+    uint32_t x = sobol(shuffled, dimension % SOBOL_DIMENSIONS);
+    return nested_uniform_scramble(x, hash_combine(group_seed, dimension % SOBOL_DIMENSIONS));
+}
+
+float UniformSampler::sample(uint32_t pixel, uint32_t index, uint32_t dimension) const {
+    return to_unit_float(hash_combine(hash_combine(hash_combine(seed, pixel), index), dimension));
+}
+
+float SobolSampler::sample(uint32_t pixel, uint32_t index, uint32_t dimension) const {
+    return to_unit_float(owen_sobol(index, dimension, hash_combine(seed, pixel)));
+}
+
+/**
+ * @brief 用void-and-cluster算法生成BLUE_NOISE_SIZE x BLUE_NOISE_SIZE的蓝噪声纹理
+ * @param ranks (Not Free) 输出, 每个像素的rank, 取值为0到BLUE_NOISE_SIZE^2 - 1的一个排列
+ */
+static void void_and_cluster(vector<uint32_t> *ranks) {
+    const int n = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+    const float sigma = 1.5f;
+    // toroidal距离下的高斯核, kernel[dy * size + dx]
+    vector<float> kernel(n);
+    for (int dy = 0; dy < BLUE_NOISE_SIZE; dy++) {
+        for (int dx = 0; dx < BLUE_NOISE_SIZE; dx++) {
+            int tx = min(dx, BLUE_NOISE_SIZE - dx);
+            int ty = min(dy, BLUE_NOISE_SIZE - dy);
+            kernel[dy * BLUE_NOISE_SIZE + dx] = exp(-(tx * tx + ty * ty) / (2 * sigma * sigma));
+        }
+    }
+    vector<char> pattern(n, 0); // binary pattern
+    vector<float> energy(n, 0);
+    auto toggle = [&](int p, float sign) {
+        int px = p % BLUE_NOISE_SIZE;
+        int py = p / BLUE_NOISE_SIZE;
+        for (int y = 0; y < BLUE_NOISE_SIZE; y++) {
+            int dy = (y - py + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+            for (int x = 0; x < BLUE_NOISE_SIZE; x++) {
+                int dx = (x - px + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+                energy[y * BLUE_NOISE_SIZE + x] += sign * kernel[dy * BLUE_NOISE_SIZE + dx];
+            }
+        }
+        pattern[p] = sign > 0;
+    };
+    // tightest cluster: 能量最大的1; largest void: 能量最小的0
+    auto tightest_cluster = [&]() {
+        int best = -1;
+        for (int i = 0; i < n; i++) {
+            if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+                best = i;
+        }
+        return best;
+    };
+    auto largest_void = [&]() {
+        int best = -1;
+        for (int i = 0; i < n; i++) {
+            if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+                best = i;
+        }
+        return best;
+    };
+
+    // 初始图案: 确定性的1/10随机点, 然后反复把最紧的簇移到最大的空洞, 直到稳定
+    int num_initial = n / 10;
+    for (uint32_t i = 0, count = 0; count < (uint32_t)num_initial; i++) {
+        int p = hash_u32(i) % n;
+        if (!pattern[p]) {
+            toggle(p, 1);
+            count++;
+        }
+    }
+    while (true) {
+        int cluster = tightest_cluster();
+        toggle(cluster, -1);
+        int hole = largest_void();
+        if (hole == cluster) {
+            toggle(cluster, 1);
+            break;
+        }
+        toggle(hole, 1);
+    }
+    vector<char> initial = pattern;
+    vector<float> initial_energy = energy;
+
+    ranks->assign(n, 0);
+    // phase 1: 依次移除最紧的簇, rank从num_initial - 1递减
+    for (int rank = num_initial - 1; rank >= 0; rank--) {
+        int cluster = tightest_cluster();
+        toggle(cluster, -1);
+        (*ranks)[cluster] = rank;
+    }
+    // phase 2: 从初始图案开始依次填充最大的空洞, rank从num_initial递增
+    pattern = initial;
+    energy = initial_energy;
+    for (int rank = num_initial; rank < n; rank++) {
+        int hole = largest_void();
+        toggle(hole, 1);
+        (*ranks)[hole] = rank;
+    }
+}
+
+/**
+ * @brief 蓝噪声纹理, 第一次调用时生成, 之后只读
+ */
+static const vector<uint32_t> &blue_noise_ranks() {
+    static vector<uint32_t> ranks;
+    static once_flag flag;
+    call_once(flag, [] { void_and_cluster(&ranks); });
+    return ranks;
+}
+
+BlueNoiseSampler::BlueNoiseSampler(uint32_t seed, uint32_t width) : seed(seed), width(width == 0 ? 1 : width) { blue_noise_ranks(); }
+
+float BlueNoiseSampler::sample(uint32_t pixel, uint32_t index, uint32_t dimension) const {
+    const vector<uint32_t> &ranks = blue_noise_ranks();
+    uint32_t x = pixel % width;
+    uint32_t y = pixel / width;
+    // 每一维把纹理平移一个由维度决定的伪随机偏移, 使各维度的蓝噪声互不相关
+    uint32_t offset = hash_combine(seed, dimension);
+    uint32_t tx = (x + (offset & (BLUE_NOISE_SIZE - 1))) & (BLUE_NOISE_SIZE - 1);
+    uint32_t ty = (y + ((offset >> BLUE_NOISE_BITS) & (BLUE_NOISE_SIZE - 1))) & (BLUE_NOISE_SIZE - 1);
+    uint32_t rank = ranks[ty * BLUE_NOISE_SIZE + tx];
+    // rank / n是[0, 1)内的蓝噪声值, 加上半个间隔的随机抖动后作为toroidal平移量
+    uint32_t shift = (rank << (32 - 2 * BLUE_NOISE_BITS)) + (hash_combine(offset, rank) >> (2 * BLUE_NOISE_BITS));
+    return to_unit_float(owen_sobol(index, dimension, seed) + shift);
+}
@@ -5,20 +5,21 @@
 #include <mathutils.h>
 #include <surface.h>
 #include <hitrecord.h>
+#include <cmath>
 
 AABB::AABB(float x_low, float x_high, float y_low, float y_high, float z_low, float z_high) : p0(x_low, y_low, z_low), p1(x_high, y_high, z_high) {
     float temp = 0;
-    if (p0[0] < p1[0]) {
+    if (p0[0] > p1[0]) {
         temp = p0[0];
         p0[0] = p1[0];
         p1[0] = temp;
     }
-    if (p0[1] < p1[1]) {
+    if (p0[1] > p1[1]) {
         temp = p0[1];
         p0[1] = p1[1];
         p1[1] = temp;
     }
-    if (p0[2] < p1[2]) {
+    if (p0[2] > p1[2]) {
         temp = p0[2];
         p0[2] = p1[2];
         p1[2] = temp;
@@ -26,60 +27,90 @@ AABB::AABB(float x_low, float x_high, float y_low, float y_high, float z_low, fl
 }
 
 bool AABB::ray_hit(const Ray &ray, float t0, float t1, HitRecord *hit_record) const {
-    if (hit_record != nullptr)
-        hit_record->hit = false;
-
-    float t_x0, t_x1, t_y0, t_y1, t_z0, t_z1;
-    int num_solution = 0;
-    t_x0 = solve_one_variable_linear(ray.d[0], p0[0] - ray.o[0], &num_solution);
-    if (num_solution != 1)
-        return false;
-    t_x1 = solve_one_variable_linear(ray.d[0], p1[0] - ray.o[0], &num_solution);
-    if (num_solution != 1)
-        return false;
-    t_y0 = solve_one_variable_linear(ray.d[1], p0[1] - ray.o[1], &num_solution);
-    if (num_solution != 1)
-        return false;
-    t_y1 = solve_one_variable_linear(ray.d[1], p1[1] - ray.o[1], &num_solution);
-    if (num_solution != 1)
-        return false;
-    t_z0 = solve_one_variable_linear(ray.d[2], p0[2] - ray.o[2], &num_solution);
-    if (num_solution != 1)
-        return false;
-    t_z1 = solve_one_variable_linear(ray.d[2], p1[2] - ray.o[2], &num_solution);
-    if (num_solution != 1)
-        return false;
-
-    float enter_x, exit_x, enter_y, exit_y, enter_z, exit_z;
-    if (t_x0 < t_x1) {
-        enter_x = t_x0;
-        exit_x = t_x1;
-    } else {
-        enter_x = t_x1;
-        exit_x = t_x0;
+    float t = 0;
+    bool hit = aabb_ray_slab(PrecomputedRay(ray), *this, t0, t1, &t);
+    if (hit_record != nullptr) {
+        hit_record->hit = hit;
+        if (hit)
+            hit_record->t = t;
     }
-    if (t_y0 < t_y1) {
-        enter_y = t_y0;
-        exit_y = t_y1;
-    } else {
-        enter_y = t_y1;
-        exit_y = t_y0;
-    }
-    if (t_z0 < t_z1) {
-        enter_z = t_z0;
-        exit_z = t_z1;
+    return hit;
+}
+
+bool watertight_triangle_hit(const PrecomputedRay &ray, const Eigen::Vector3f &a, const Eigen::Vector3f &b, const Eigen::Vector3f &c,
+                             float t0, float t1, float *t) {
+    // 顶点平移到射线起点后转置, 每个Float4的三个通道依次是a, b, c的同一个坐标
+    Float4 coords[3];
+    transpose3(float4_from_vector3(a) - ray.o, float4_from_vector3(b) - ray.o, float4_from_vector3(c) - ray.o, coords, coords + 1,
+               coords + 2);
+    // 剪切变换, 射线变为沿+z的单位射线
+    Float4 z = coords[ray.kz];
+    Float4 x = coords[ray.kx] - Float4(ray.shear[0]) * z;
+    Float4 y = coords[ray.ky] - Float4(ray.shear[1]) * z;
+    z = Float4(ray.shear[2]) * z;
+    // 边函数(U, V, W) = (c.x * b.y - c.y * b.x, a.x * c.y - a.y * c.x, b.x * a.y - b.y * a.x)
+    Float4 uvw = shuffle<2, 0, 1, 3>(x) * shuffle<1, 2, 0, 3>(y) - shuffle<2, 0, 1, 3>(y) * shuffle<1, 2, 0, 3>(x);
+    if ((mask_eq(uvw, Float4()) & 7) == 0) {
+        // 三个边函数都不为0时, 同时有正有负说明射线在三角形外
+        if ((mask_lt(uvw, Float4()) & 7) != 0 && (mask_lt(Float4(), uvw) & 7) != 0)
+            return false;
     } else {
-        enter_z = t_z1;
-        exit_z = t_z0;
+        // 射线穿过边或顶点, 用double重新计算以免符号判断错误
+        double ax = x[0], bx = x[1], cx = x[2];
+        double ay = y[0], by = y[1], cy = y[2];
+        uvw = Float4((float)(cx * by - cy * bx), (float)(ax * cy - ay * cx), (float)(bx * ay - by * ax), 0);
+        if ((uvw[0] < 0 || uvw[1] < 0 || uvw[2] < 0) && (uvw[0] > 0 || uvw[1] > 0 || uvw[2] > 0))
+            return false;
     }
-
-    float max_enter = enter_x > enter_y ? (enter_x > enter_z ? enter_x : enter_z) : (enter_y > enter_z ? enter_y : enter_z);
-    if (max_enter > t1)
+    float u = uvw[0];
+    float v = uvw[1];
+    float w = uvw[2];
+    float det = u + v + w; // determinant
+    if (det == 0)
         return false;
-    float min_exit = enter_x < enter_y ? (enter_x < enter_z ? enter_x : enter_z) : (enter_y < enter_z ? enter_y : enter_z);
-    if (min_exit < t0 || min_exit < max_enter)
+    float t_hit = (u * z[0] + v * z[1] + w * z[2]) / det;
+    if (!(t_hit >= t0 && t_hit <= t1))
         return false;
-    hit_record->hit = true;
-    hit_record->t = max_enter;
+    if (t != nullptr)
+        *t = t_hit;
     return true;
 }
+
+bool FaceSurface::ray_hit(const Ray &ray, float t0, float t1, HitRecord *hit_record) const {
+    return ray_hit_precomputed(PrecomputedRay(ray), t0, t1, hit_record);
+}
+
+bool FaceSurface::ray_hit_precomputed(const PrecomputedRay &ray, float t0, float t1, HitRecord *hit_record) const {
+    if (hit_record != nullptr)
+        hit_record->hit = false;
+    if (face == nullptr || face->h == nullptr)
+        return false;
+    // 对扇形三角化得到的每个三角形(h->v, e->v, e->next->v)求交
+    const Eigen::Vector3f &a = face->h->v->co;
+    bool hit = false;
+    for (HEdge *e = face->h->next; e->next != face->h; e = e->next) {
+        float t = 0;
+        if (!watertight_triangle_hit(ray, a, e->v->co, e->next->v->co, t0, t1, &t))
+            continue;
+        hit = true;
+        t1 = t;
+        if (hit_record != nullptr) {
+            hit_record->hit = true;
+            hit_record->t = t;
+            hit_record->normal = (e->v->co - a).cross(e->next->v->co - a).normalized();
+        }
+    }
+    return hit;
+}
+
+AABB FaceSurface::aabb() const {
+    if (face == nullptr || face->h == nullptr)
+        return AABB(0, 0, 0, 0, 0, 0);
+    Eigen::Vector3f lo = face->h->v->co;
+    Eigen::Vector3f hi = face->h->v->co;
+    for (HEdge *e = face->h->next; e != nullptr && e != face->h; e = e->next) {
+        lo = lo.cwiseMin(e->v->co);
+        hi = hi.cwiseMax(e->v->co);
+    }
+    return AABB(lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file threadpool.cpp
+ * @brief threadpool.h的具体实现
+ */
+#include <algorithm>
+#include <threadpool.h>
+
+using namespace std;
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads < 1) {
+        num_threads = max(1, (int)thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_threads; i++) {
+        workers.emplace_back([this] {
+            unique_lock<mutex> guard(lock);
+            while (true) {
+                task_cv.wait(guard, [this] { return stop || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return; // stop
+                }
+                function<void()> task = std::move(tasks.front());
+                tasks.pop_front();
+                num_running++;
+                guard.unlock();
+                task();
+                guard.lock();
+                num_running--;
+                if (tasks.empty() && num_running == 0) {
+                    idle_cv.notify_all();
+                }
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    task_cv.notify_all();
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<mutex> guard(lock);
+        tasks.push_back(std::move(task));
+    }
+    task_cv.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(lock);
+    idle_cv.wait(guard, [this] { return tasks.empty() && num_running == 0; });
+}
@@ -1,6 +1,10 @@
 add_rules("mode.debug", "mode.release")
+set_languages("c++17")
 
 target("ray_tracing")
     set_kind("binary")
     add_files("sources/*.cpp")
     add_includedirs("headers", "thirdparty")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end